@@ -0,0 +1,327 @@
+/** riban heating controller - control logic
+*   Reading filter, zone hysteresis control, outdoor temperature compensation, zone demand scheduling, thermal model and hysteresis tuning.
+*/
+#include "control.h"
+
+/** @brief  Passes a new reading through a sensor's filter
+*   @param  pSensor Pointer to sensor
+*   @param  nValue Raw reading (C/100)
+*   @param  nShift Exponential moving average weight of each new reading (1/2^n). 0 = median only
+*   @note   Median of last three readings rejects single sample spikes then exponential moving average smooths quantisation noise
+*   @note   Updates sensor's nValue with filtered result. Fixed number of operations per reading.
+*/
+void FilterReading(sensor* pSensor, int nValue, byte nShift)
+{
+    if(pSensor->nSamples < 2)
+    {
+        //Not enough history for median so seed filter with latest reading
+        pSensor->nHistory[pSensor->nSamples++] = nValue;
+        pSensor->lFilter = (long)nValue << nShift;
+        pSensor->nValue = nValue;
+        return;
+    }
+    //Median of three
+    int nLow = pSensor->nHistory[0];
+    int nHigh = pSensor->nHistory[1];
+    if(nLow > nHigh)
+    {
+        nLow = pSensor->nHistory[1];
+        nHigh = pSensor->nHistory[0];
+    }
+    pSensor->nHistory[0] = pSensor->nHistory[1];
+    pSensor->nHistory[1] = nValue;
+    if(nValue < nLow)
+        nValue = nLow;
+    else if(nValue > nHigh)
+        nValue = nHigh;
+    //Exponential moving average
+    pSensor->lFilter += nValue - (pSensor->lFilter >> nShift);
+    pSensor->nValue = pSensor->lFilter >> nShift;
+}
+
+/** @brief  Updates a zone's call for heat from a sensor reading
+*   @param  pZone Pointer to zone
+*   @param  nValue Filtered reading of sensor in zone (C/100)
+*   @note   Calls for heat when reading falls below set-point less hysteresis and stops when it rises above set-point
+*   @note   Set-point includes zone's outdoor temperature compensation
+*/
+void UpdateZone(zone* pZone, int nValue)
+{
+    int nSetpoint = pZone->nSetpoint + pZone->nCompensation;
+    pZone->bBelow = (nSetpoint > nValue / 10);
+    pZone->bDue = (nSetpoint - pZone->nHyst / 2 > nValue / 10);
+    if(nSetpoint < nValue / 10)
+        pZone->bOn = false; //Gone over setpoint
+    if(nSetpoint - pZone->nHyst > nValue / 10)
+        pZone->bOn = true; //Gone below hysteresis point
+}
+
+/** @brief  Gets set-point compensation from a zone's compensation curve
+*   @param  pCurve Pointer to CURVE_POINTS pairs of breakpoint: outdoor temperature (C), set-point offset (C/10)
+*   @param  nOutdoor Outdoor temperature (C/10)
+*   @return <i>int</i> Set-point offset (C/10) linearly interpolated between breakpoints, held at end values beyond the curve
+*   @note   Breakpoints must be in strictly ascending order of outdoor temperature. Any other table (including erased
+*           EEPROM) is treated as no curve and returns zero.
+*/
+int InterpolateCurve(const signed char* pCurve, int nOutdoor)
+{
+    for(unsigned char nPoint = 1; nPoint < CURVE_POINTS; ++nPoint)
+        if(pCurve[nPoint * 2] <= pCurve[nPoint * 2 - 2])
+            return 0;
+    if(nOutdoor <= pCurve[0] * 10)
+        return pCurve[1];
+    for(unsigned char nPoint = 1; nPoint < CURVE_POINTS; ++nPoint)
+    {
+        int nUpper = pCurve[nPoint * 2] * 10;
+        if(nOutdoor < nUpper)
+        {
+            int nLower = pCurve[nPoint * 2 - 2] * 10;
+            int nOffset = pCurve[nPoint * 2 - 1];
+            return nOffset + (long)(pCurve[nPoint * 2 + 1] - nOffset) * (nOutdoor - nLower) / (nUpper - nLower);
+        }
+    }
+    return pCurve[CURVE_POINTS * 2 - 1];
+}
+
+/** @brief  Counts set bits
+*   @param  nValue Value to count
+*   @return <i>unsigned char</i> Quantity of bits set in value
+*/
+static unsigned char CountBits(unsigned int nValue)
+{
+    unsigned char nCount = 0;
+    for(; nValue; nValue &= nValue - 1)
+        ++nCount;
+    return nCount;
+}
+
+/** @brief  Schedules boiler, pump and zone valves from zones' calls for heat
+*   @param  pScheduler Pointer to scheduler
+*   @param  pZones Pointer to array of zones
+*   @param  nZones Quantity of zones (maximum 16)
+*   @note   Call once per control period after zones are updated
+*   @note   Priority zones calling for heat are served alone for up to nMaxHold periods, then all calls are served together
+*   @note   When the boiler starts, zones in the lower half of their hysteresis band (not yet calling for heat) share the
+*           burn until they reach set-point. This batches demand which would otherwise start the boiler again shortly after.
+*           A space zone joins only if the pump is already running for the burn so joining costs no more than its valve.
+*/
+void ScheduleDemand(scheduler* pScheduler, const zone* pZones, unsigned char nZones)
+{
+    unsigned int nDemand = 0;
+    unsigned int nBelow = 0;
+    unsigned int nDue = 0;
+    unsigned int nSpace = 0;
+    for(unsigned char nZone = 0; nZone < nZones; ++nZone)
+    {
+        if(pZones[nZone].bOn)
+            nDemand |= 1 << nZone;
+        if(pZones[nZone].bBelow)
+            nBelow |= 1 << nZone;
+        if(pZones[nZone].bDue)
+            nDue |= 1 << nZone;
+        if(pZones[nZone].bSpace)
+            nSpace |= 1 << nZone;
+    }
+
+    //Priority
+    unsigned int nAllowed = ~0U;
+    if((nDemand & pScheduler->nPriority) && (nDemand & ~pScheduler->nPriority) && pScheduler->nHold < pScheduler->nMaxHold)
+    {
+        ++pScheduler->nHold;
+        nAllowed = pScheduler->nPriority; //Hold off other zones
+    }
+    else if(!(nDemand & pScheduler->nPriority))
+        pScheduler->nHold = 0; //Priority satisfied so full hold time available to next call
+    unsigned int nValves = nDemand & nAllowed;
+
+    //Batch zones due to call into burn. Zones join only as burn starts and leave at set-point so do not chatter.
+    if(!nValves)
+        pScheduler->nBatch = 0;
+    else if(!pScheduler->bBoiler)
+    {
+        pScheduler->nBatch = pScheduler->bBatch ? (nDue & nAllowed & ~nValves) : 0;
+        if(!(nValves & nSpace))
+            pScheduler->nBatch &= ~nSpace; //Pump start would cost more than the batch is likely to save
+        pScheduler->nBatched += CountBits(pScheduler->nBatch);
+    }
+    else
+        pScheduler->nBatch &= nBelow & nAllowed & ~nValves;
+    nValves |= pScheduler->nBatch;
+
+    bool bBoiler = (nValves != 0);
+    bool bPump = ((nValves & nSpace) != 0);
+    pScheduler->nTransitions += CountBits(pScheduler->nValves ^ nValves);
+    pScheduler->nTransitions += (pScheduler->bBoiler != bBoiler);
+    pScheduler->nTransitions += (pScheduler->bPump != bPump);
+    pScheduler->nStarts += (bBoiler && !pScheduler->bBoiler);
+    pScheduler->nValves = nValves;
+    pScheduler->bBoiler = bBoiler;
+    pScheduler->bPump = bPump;
+}
+
+/** @brief  Seeds a thermal model with previously learned coefficients
+*   @param  pModel Pointer to model
+*   @param  nLoss Heat loss coefficient (see model::nLoss)
+*   @param  nGain Heat gain coefficient (see model::nGain)
+*   @note   Seeded coefficients carry the weight of MODEL_MIN_SAMPLES updates so new readings soon refine them
+*/
+void SeedModel(model* pModel, int nLoss, int nGain)
+{
+    //Typical period: 20C difference (200), 5 minutes heating
+    pModel->lSxx = 200L * 200 * MODEL_MIN_SAMPLES;
+    pModel->lSxy = (pModel->lSxx / 256) * nLoss / 256;
+    pModel->nSuu = 5 * 5 * MODEL_MIN_SAMPLES;
+    pModel->lSur = (long)pModel->nSuu * nGain / 256;
+    pModel->nLoss = nLoss;
+    pModel->nGain = nGain;
+    pModel->nLossSamples = MODEL_MIN_SAMPLES;
+    pModel->nGainSamples = MODEL_MIN_SAMPLES;
+}
+
+/** @brief  Adds a reading to a zone's thermal model
+*   @param  pModel Pointer to model
+*   @param  nValue Zone temperature (C/100)
+*   @param  nOutdoor Outdoor temperature (C/10)
+*   @param  bHeating True if zone will be heated until next sample
+*   @note   Call once per minute. Every MODEL_PERIOD samples the rise over the period updates an exponentially weighted
+*           recursive least squares fit of rise = loss x (outdoor - indoor) + gain x heating minutes. Heat loss is fitted
+*           from periods without heat and heat gain from the remainder of heated periods, so each is a scalar fit and
+*           the update is a few 32-bit multiplies and one division.
+*/
+void SampleModel(model* pModel, int nValue, int nOutdoor, bool bHeating)
+{
+    if(pModel->nMinutes >= MODEL_PERIOD)
+    {
+        long lX = pModel->nDiff;
+        long lRise = nValue - pModel->nStart;
+        if(pModel->nOn == 0)
+        {
+            pModel->lSxx += lX * lX - (pModel->lSxx >> MODEL_FORGET);
+            pModel->lSxy += lX * lRise - (pModel->lSxy >> MODEL_FORGET);
+            if(pModel->lSxx >= 256)
+            {
+                long lLoss = pModel->lSxy * 256 / (pModel->lSxx >> 8);
+                pModel->nLoss = (lLoss > 32767) ? 32767 : (lLoss < -32767) ? -32767 : lLoss;
+            }
+            if(pModel->nLossSamples < 255)
+                ++pModel->nLossSamples;
+        }
+        else
+        {
+            long lResidual = lRise - ((long)pModel->nLoss * lX >> 16);
+            pModel->nSuu += pModel->nOn * pModel->nOn - (pModel->nSuu >> MODEL_FORGET);
+            pModel->lSur += pModel->nOn * lResidual - (pModel->lSur >> MODEL_FORGET);
+            if(pModel->nSuu > 0)
+            {
+                long lGain = pModel->lSur * 256 / pModel->nSuu;
+                pModel->nGain = (lGain > 32767) ? 32767 : (lGain < -32767) ? -32767 : lGain;
+            }
+            if(pModel->nGainSamples < 255)
+                ++pModel->nGainSamples;
+        }
+        pModel->nMinutes = 0;
+    }
+    if(pModel->nMinutes == 0)
+    {
+        pModel->nStart = nValue;
+        pModel->nDiff = nOutdoor - nValue / 10;
+        pModel->nOn = 0;
+    }
+    if(bHeating)
+        ++pModel->nOn;
+    ++pModel->nMinutes;
+}
+
+/** @brief  Predicts a zone's temperature rise over one model period
+*   @param  pModel Pointer to model
+*   @param  nValue Zone temperature (C/100)
+*   @param  nOutdoor Outdoor temperature (C/10)
+*   @param  nOnMinutes Minutes of heating in period (0 - MODEL_PERIOD)
+*   @return <i>int</i> Predicted rise (C/100), negative for a fall
+*/
+int PredictRise(const model* pModel, int nValue, int nOutdoor, unsigned char nOnMinutes)
+{
+    long lX = nOutdoor - nValue / 10;
+    return ((long)pModel->nLoss * lX >> 16) + ((long)pModel->nGain * nOnMinutes >> 8);
+}
+
+/** @brief  Ends a zone's call for heat early when its model predicts set-point will be reached within the next minute
+*   @param  pZone Pointer to zone
+*   @param  pModel Pointer to zone's model
+*   @param  nValue Zone temperature (C/100)
+*   @param  nOutdoor Outdoor temperature (C/10)
+*   @note   Only acts once both model coefficients have MODEL_MIN_SAMPLES updates
+*/
+void AnticipateZone(zone* pZone, const model* pModel, int nValue, int nOutdoor)
+{
+    if(!pZone->bOn || pModel->nLossSamples < MODEL_MIN_SAMPLES || pModel->nGainSamples < MODEL_MIN_SAMPLES)
+        return;
+    int nRise = PredictRise(pModel, nValue, nOutdoor, MODEL_PERIOD) / MODEL_PERIOD; //Rise in one minute of heating
+    if(nValue + nRise >= (pZone->nSetpoint + pZone->nCompensation) * 10)
+        pZone->bOn = false;
+}
+
+/** @brief  Adjusts a zone's hysteresis toward a target cycle rate
+*   @param  pTuner Pointer to zone's tuner
+*   @param  pZone Pointer to zone
+*   @param  nValue Zone temperature (C/100)
+*   @param  nRate Target cycles per hour (1 - 60)
+*   @param  nMin Minimum hysteresis (C/10)
+*   @param  nMax Maximum hysteresis (C/10)
+*   @return <i>bool</i> True when hysteresis has just settled (TUNE_SETTLE_CYCLES cycles without adjustment)
+*   @note   Call once per minute after zone control. Each call for heat ends a cycle. Cycle period is roughly
+*           proportional to temperature swing (hysteresis plus overshoot above set-point) so hysteresis is moved toward
+*           the swing that would give the target period, at most TUNE_MAX_STEP per cycle. Cycles within 25% of target
+*           leave hysteresis unchanged.
+*/
+bool TuneZone(tuner* pTuner, zone* pZone, int nValue, unsigned char nRate, unsigned char nMin, unsigned char nMax)
+{
+    bool bSettled = false;
+    if(pTuner->nMinutes < 0xFFFF)
+        ++pTuner->nMinutes;
+    if(!pZone->bOn && nValue > pTuner->nPeak)
+        pTuner->nPeak = nValue;
+    if(pZone->bOn && !pTuner->bWasOn)
+    {
+        //Call for heat ends cycle
+        unsigned int nTarget = 60 / nRate;
+        if(pTuner->bStarted && pTuner->nMinutes <= nTarget * TUNE_MAX_RATIO)
+        {
+            pTuner->nPeriod = pTuner->nMinutes;
+            int nOvershoot = pTuner->nPeak - (pZone->nSetpoint + pZone->nCompensation) * 10;
+            pTuner->nOvershoot = (nOvershoot > 0) ? nOvershoot : 0;
+            int nHyst = pZone->nHyst;
+            if(pTuner->nPeriod * 4 < nTarget * 3 || pTuner->nPeriod * 4 > nTarget * 5)
+            {
+                long lSwing = (long)nHyst * 10 + pTuner->nOvershoot;
+                int nDesired = (lSwing * nTarget / pTuner->nPeriod - pTuner->nOvershoot) / 10;
+                if(nDesired > nHyst + TUNE_MAX_STEP)
+                    nDesired = nHyst + TUNE_MAX_STEP;
+                else if(nDesired < nHyst - TUNE_MAX_STEP)
+                    nDesired = nHyst - TUNE_MAX_STEP;
+                nHyst = nDesired;
+            }
+            if(nHyst < nMin)
+                nHyst = nMin;
+            if(nHyst > nMax)
+                nHyst = nMax;
+            if(nHyst == pZone->nHyst)
+            {
+                if(pTuner->nSettled < 255)
+                    ++pTuner->nSettled;
+                bSettled = (pTuner->nSettled == TUNE_SETTLE_CYCLES);
+            }
+            else
+            {
+                pZone->nHyst = nHyst;
+                pTuner->nSettled = 0;
+            }
+        }
+        pTuner->bStarted = true;
+        pTuner->nMinutes = 0;
+    }
+    if(!pZone->bOn && pTuner->bWasOn)
+        pTuner->nPeak = nValue; //Start measuring overshoot
+    pTuner->bWasOn = pZone->bOn;
+    return bSettled;
+}
@@ -0,0 +1,100 @@
+/** riban heating controller - control logic
+*   Reading filter, zone hysteresis control, outdoor temperature compensation, zone demand scheduling, thermal model and hysteresis tuning.
+*   Has no dependency on hardware or Arduino libraries so that the same code runs in the controller and in host tools.
+*/
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#ifdef ARDUINO
+#include "Arduino.h"
+#else
+#include <stdint.h>
+typedef uint8_t byte;
+#endif // ARDUINO
+
+const unsigned char CURVE_POINTS = 4; //Quantity of breakpoints in each compensation curve
+const unsigned char MODEL_PERIOD = 10; //Quantity of samples (minutes) in each thermal model update
+const unsigned char MODEL_FORGET = 5; //Thermal model forgetting factor is 1 - 1/2^n per update
+const unsigned char MODEL_MIN_SAMPLES = 6; //Quantity of updates before a coefficient is used for prediction
+const unsigned char TUNE_SETTLE_CYCLES = 4; //Quantity of consecutive cycles without adjustment before tuned hysteresis is settled
+const unsigned char TUNE_MAX_STEP = 2; //Maximum hysteresis adjustment per cycle (C/10)
+const unsigned char TUNE_MAX_RATIO = 4; //Cycles longer than this multiple of target period are limited by demand and ignored
+
+struct sensor
+{
+    byte address[8]; //UID
+    int nValue; //Current filtered value (C/100)
+    byte nZone; //Zone this sensor measures or contributes to
+    int nHistory[2]; //Previous two raw readings for median filter (C/100)
+    long lFilter; //Moving average accumulator (C/100 << filter shift)
+    byte nSamples; //Quantity of readings in history (saturates at 2)
+    unsigned int nCrcRetries; //Quantity of scratchpad re-reads after CRC failure
+    unsigned int nCrcErrors; //Quantity of readings lost after all re-reads failed
+    unsigned int nPowerOn; //Quantity of power-on values that triggered a new conversion
+};
+
+struct zone
+{
+    int nSetpoint; //Temperature set-point (C/10)
+    int nCompensation; //Outdoor temperature compensation added to set-point (C/10)
+    byte nHyst; //Hysteresis value (C/10)
+    bool bOn; //True if calling for heat
+    bool bBelow; //True if below set-point
+    bool bDue; //True if in lower half of hysteresis band so will soon call for heat
+    bool bSpace; //True if space heating zone (room, not water cylinder, requires pump)
+    char sName[10]; //Name of zone
+};
+
+struct scheduler
+{
+    unsigned int nPriority; //Bitwise flag of zones served before others (e.g. hot water cylinder)
+    unsigned char nMaxHold; //Maximum control periods priority zones may hold off other zones. 0 to disable priority
+    bool bBatch; //True to let zones due to call for heat share a burn
+    unsigned char nHold; //Control periods priority zones have held off other zones
+    unsigned int nValves; //Bitwise flag of zones scheduled for heat
+    unsigned int nBatch; //Bitwise flag of zones sharing current burn without calling for heat
+    bool bBoiler; //True if boiler scheduled on
+    bool bPump; //True if pump scheduled on
+    unsigned int nTransitions; //Quantity of relay transitions (boiler, pump and valves)
+    unsigned int nStarts; //Quantity of boiler starts
+    unsigned int nBatched; //Quantity of zones that shared a burn instead of calling for heat later
+};
+
+struct model
+{
+    long lSxx; //Weighted sum of squared indoor-outdoor difference over periods without heat
+    long lSxy; //Weighted sum of difference x rise over periods without heat
+    long lSur; //Weighted sum of heating minutes x rise not explained by heat loss
+    int nSuu; //Weighted sum of squared heating minutes
+    int nLoss; //Heat loss coefficient: rise per period (C/100) per indoor-outdoor difference (C/10) << 16
+    int nGain; //Heat gain coefficient: rise per period (C/100) per minute of heating << 8
+    unsigned char nLossSamples; //Quantity of updates of heat loss (saturates at 255)
+    unsigned char nGainSamples; //Quantity of updates of heat gain (saturates at 255)
+    int nStart; //Temperature at start of period (C/100)
+    int nDiff; //Outdoor less indoor temperature at start of period (C/10)
+    unsigned char nOn; //Minutes of heating in period
+    unsigned char nMinutes; //Minutes sampled in period
+};
+
+struct tuner
+{
+    unsigned int nMinutes; //Minutes since zone last started calling for heat
+    unsigned int nPeriod; //Last measured cycle period (minutes). 0 if not measured
+    int nPeak; //Highest reading since zone stopped calling for heat (C/100)
+    int nOvershoot; //Last measured rise above set-point after zone stopped calling for heat (C/100)
+    unsigned char nSettled; //Consecutive cycles without adjustment (saturates at 255)
+    bool bStarted; //True once a call for heat has started the first cycle
+    bool bWasOn; //Zone call for heat at previous sample
+};
+
+void FilterReading(sensor* pSensor, int nValue, byte nShift);
+void UpdateZone(zone* pZone, int nValue);
+int InterpolateCurve(const signed char* pCurve, int nOutdoor);
+void ScheduleDemand(scheduler* pScheduler, const zone* pZones, unsigned char nZones);
+void SeedModel(model* pModel, int nLoss, int nGain);
+void SampleModel(model* pModel, int nValue, int nOutdoor, bool bHeating);
+int PredictRise(const model* pModel, int nValue, int nOutdoor, unsigned char nOnMinutes);
+void AnticipateZone(zone* pZone, const model* pModel, int nValue, int nOutdoor);
+bool TuneZone(tuner* pTuner, zone* pZone, int nValue, unsigned char nRate, unsigned char nMin, unsigned char nMax);
+
+#endif // CONTROL_H
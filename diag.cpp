@@ -0,0 +1,151 @@
+/** riban heating controller - timing diagnostics
+*   Timer2 runs in CTC mode at F_CPU / 32 (2us per count at 16MHz) and interrupts every DIAG_PERIOD counts. On entry the handler reads the
+*   counter, which has counted on from zero since the compare match, so the count is the interrupt latency. Each sample
+*   delayed beyond DIAG_BASELINE stands for DIAG_PERIOD of blocked time so the blocked total is a statistical estimate.
+*   Windows longer than one period wrap the counter and are under-reported; millis() drift against the RTC shows them.
+*/
+
+#include "diag.h"
+
+#if FEATURE_DIAG
+
+const byte DIAG_PERIOD = 250; //Timer2 counts between samples (500us at 16MHz)
+const byte DIAG_US_PER_COUNT = 32000000UL / F_CPU; //Timer2 clock is F_CPU / 32
+typedef char DiagWholeMicroseconds[(32000000UL % F_CPU == 0) ? 1 : -1]; //Fails to compile if a count is not a whole number of microseconds
+const byte DIAG_BASELINE = 3; //Latency counts of interrupt entry with interrupts enabled
+const unsigned long DIAG_DRIFT_WINDOW = 86400; //Seconds of RTC time in each drift measurement
+const unsigned long SECONDS_PER_WEEK = 604800;
+const char DIAG_NAMES[PHASE_COUNT][9] PROGMEM = {"idle", "clock", "schedule", "sensor", "control", "serial", "lcd"};
+
+volatile byte g_nPhase = PHASE_IDLE;
+volatile unsigned long g_lDiagSamples[PHASE_COUNT]; //Samples taken in each phase
+volatile unsigned long g_lDiagBlocked[PHASE_COUNT]; //Samples delayed beyond baseline in each phase
+volatile byte g_nDiagMax[PHASE_COUNT]; //Longest latency in each phase (counts)
+unsigned long g_lDriftMillis; //millis() at start of drift window
+unsigned long g_lDriftRtc = 0xFFFFFFFF; //RTC seconds of week at start of drift window. 0xFFFFFFFF before first reading
+long g_lDrift; //millis() gained over RTC in current window (ms)
+unsigned long g_lDriftElapsed; //RTC seconds in current window
+long g_lDriftLast; //millis() gain of last complete window (ppm)
+bool g_bDriftLast = false; //True when a window has completed
+
+/** @brief  Starts latency sampling
+*   @note   Uses Timer2 compare A interrupt. OC2A (pin 11) stays disconnected so the pin remains a normal output.
+*/
+void DiagBegin()
+{
+    TCCR2A = _BV(WGM21); //CTC, outputs disconnected
+    TCCR2B = _BV(CS21) | _BV(CS20); //F_CPU / 32
+    OCR2A = DIAG_PERIOD - 1;
+    TCNT2 = 0;
+    TIMSK2 = _BV(OCIE2A);
+}
+
+/** @brief  Clears latency and drift measurements */
+void DiagReset()
+{
+    byte nSreg = SREG;
+    cli();
+    for(byte nPhase = 0; nPhase < PHASE_COUNT; ++nPhase)
+    {
+        g_lDiagSamples[nPhase] = 0;
+        g_lDiagBlocked[nPhase] = 0;
+        g_nDiagMax[nPhase] = 0;
+    }
+    SREG = nSreg;
+    g_lDriftRtc = 0xFFFFFFFF;
+    g_lDrift = 0;
+    g_lDriftElapsed = 0;
+    g_bDriftLast = false;
+}
+
+/** @brief  Compares millis() with RTC
+*   @param  nDay Bitwise flag of day of week. 1 = Sunday
+*   @param  nTime Minutes since 00:00
+*   @param  nSecond Seconds since minute boundary
+*   @note   Call with each RTC reading. A window restarts when the RTC goes backwards (time set) or after DIAG_DRIFT_WINDOW.
+*/
+void DiagClock(byte nDay, unsigned int nTime, byte nSecond)
+{
+    unsigned long lNow = millis();
+    byte nDow = 0;
+    while(nDay > 1)
+    {
+        nDay >>= 1;
+        ++nDow;
+    }
+    unsigned long lRtc = ((unsigned long)nDow * 1440 + nTime) * 60 + nSecond;
+    if(g_lDriftRtc != 0xFFFFFFFF)
+    {
+        unsigned long lElapsed = (lRtc + SECONDS_PER_WEEK - g_lDriftRtc) % SECONDS_PER_WEEK;
+        long lDrift = (long)(lNow - g_lDriftMillis) - (long)(lElapsed * 1000);
+        if(lDrift > 60000L || lDrift < -60000L)
+        {
+            g_lDriftRtc = 0xFFFFFFFF; //RTC was set
+        }
+        else
+        {
+            g_lDrift = lDrift;
+            g_lDriftElapsed = lElapsed;
+            if(lElapsed < DIAG_DRIFT_WINDOW)
+                return;
+            g_lDriftLast = lDrift * 1000 / (long)lElapsed; //ms per s x 1000 = ppm
+            g_bDriftLast = true;
+            g_lDrift = 0;
+            g_lDriftElapsed = 0;
+        }
+    }
+    g_lDriftMillis = lNow;
+    g_lDriftRtc = lRtc;
+}
+
+/** @brief  Prints latency of each phase and millis() drift to serial port
+*   @note   Time is samples x sample period. Blocked is estimated time with interrupts held off. Max is longest latency.
+*/
+void DiagShow()
+{
+    Serial.println(F("Phase     Time(ms)  Blocked(ms)  Max(us)"));
+    for(byte nPhase = 0; nPhase < PHASE_COUNT; ++nPhase)
+    {
+        byte nSreg = SREG;
+        cli();
+        unsigned long lSamples = g_lDiagSamples[nPhase];
+        unsigned long lBlocked = g_lDiagBlocked[nPhase];
+        byte nMax = g_nDiagMax[nPhase];
+        SREG = nSreg;
+        char sLine[10];
+        strcpy_P(sLine, DIAG_NAMES[nPhase]);
+        Serial.print(sLine);
+        for(byte i = strlen(sLine); i < 10; ++i)
+            Serial.print(' ');
+        Serial.print(lSamples * DIAG_PERIOD * DIAG_US_PER_COUNT / 1000);
+        Serial.print(F("  "));
+        Serial.print(lBlocked * DIAG_PERIOD * DIAG_US_PER_COUNT / 1000);
+        Serial.print(F("  "));
+        Serial.println(nMax * DIAG_US_PER_COUNT);
+    }
+    Serial.print(F("millis drift="));
+    Serial.print(g_lDrift);
+    Serial.print(F("ms in "));
+    Serial.print(g_lDriftElapsed);
+    Serial.print('s');
+    if(g_bDriftLast)
+    {
+        Serial.print(F(" last day="));
+        Serial.print(g_lDriftLast);
+        Serial.print(F("ppm"));
+    }
+    Serial.println();
+}
+
+/** @brief  Timer2 compare interrupt - samples latency of current phase */
+ISR(TIMER2_COMPA_vect)
+{
+    byte nLatency = TCNT2;
+    byte nPhase = g_nPhase;
+    ++g_lDiagSamples[nPhase];
+    if(nLatency > DIAG_BASELINE)
+        ++g_lDiagBlocked[nPhase];
+    if(nLatency > g_nDiagMax[nPhase])
+        g_nDiagMax[nPhase] = nLatency;
+}
+#endif // FEATURE_DIAG
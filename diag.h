@@ -0,0 +1,49 @@
+/** riban heating controller - timing diagnostics
+*   Loop phases mark which subsystem is running. A periodic Timer2 interrupt measures its own latency, which is the
+*   remainder of any window with interrupts disabled (1-Wire bit slots, LCD, other interrupt handlers), and attributes it
+*   to the current phase. millis() is compared with the RTC at each minute boundary to show time lost to long windows.
+*   When FEATURE_DIAG is disabled the functions are empty and Timer2 is left free.
+*   Phase markers also toggle the logic analyser probe when FEATURE_PROBE is enabled.
+*/
+#ifndef DIAG_H
+#define DIAG_H
+
+#include "Arduino.h"
+#include "feature.h"
+#include "probe.h"
+
+const byte PHASE_IDLE = 0; //Not in an instrumented phase
+const byte PHASE_CLOCK = 1; //RTC read
+const byte PHASE_SCHEDULE = 2; //Event processing
+const byte PHASE_SENSOR = 3; //1-Wire conversion and reading
+const byte PHASE_CONTROL = 4; //Zone control, scheduling and relay output
+const byte PHASE_SERIAL = 5; //Serial command or Modbus handling
+const byte PHASE_LCD = 6; //LCD and buttons
+const byte PHASE_COUNT = 7;
+
+#if FEATURE_DIAG
+extern volatile byte g_nPhase; //Current loop phase
+#endif // FEATURE_DIAG
+
+/** @brief  Marks start of a loop phase
+*   @param  nPhase Phase (PHASE_IDLE at end of phase)
+*/
+inline void DiagPhase(byte nPhase)
+{
+#if FEATURE_DIAG
+    g_nPhase = nPhase;
+#endif // FEATURE_DIAG
+    ProbeToggle();
+}
+
+#if FEATURE_DIAG
+void DiagBegin();
+void DiagClock(byte nDay, unsigned int nTime, byte nSecond);
+void DiagShow();
+void DiagReset();
+#else
+inline void DiagBegin() {}
+inline void DiagClock(byte, unsigned int, byte) {}
+#endif // FEATURE_DIAG
+
+#endif // DIAG_H
@@ -0,0 +1,132 @@
+/** riban heating controller - direct port access
+*   Pins are template parameters so port register and bit mask resolve at compile time, replacing the runtime pin to port
+*   table lookup of digitalRead / digitalWrite with single instruction port access.
+*   Pin numbering follows Arduino Pro Mini (ATmega328): 0-7 PORTD, 8-13 PORTB, 14-19 (A0-A5) PORTC.
+*   In host builds the port registers are RAM, Get returns the output state and each output change is passed to a hook so
+*   that tests can model the devices driven by the pins.
+*/
+#ifndef FASTIO_H
+#define FASTIO_H
+
+#ifdef ARDUINO
+#include "Arduino.h"
+#else
+#include <stdint.h>
+typedef uint8_t byte;
+
+typedef void (*FastPinHook)(byte nPin, bool bValue); //Called by host stand-in after each change of pin output
+
+/** @brief  Get host stand-in output change hook
+*   @return <i>FastPinHook&</i> Reference to hook. Set to NULL (default) for no hook.
+*/
+inline FastPinHook& FastPinGetHook()
+{
+    static FastPinHook pHook = 0;
+    return pHook;
+}
+
+/** @brief  Get host stand-in port register
+*   @param  cPort Port letter (B, C or D)
+*   @param  nRegister 0 = output, 1 = input, 2 = direction
+*   @return <i>volatile uint8_t&</i> Reference to register
+*/
+inline volatile uint8_t& FastPinGetRegister(char cPort, byte nRegister)
+{
+    static volatile uint8_t registers[3][3];
+    return registers[cPort - 'B'][nRegister];
+}
+#endif // ARDUINO
+
+template<byte PIN> struct FastPin
+{
+    typedef char PinInRange[(PIN < 20) ? 1 : -1]; //Fails to compile for pins not on ATmega328 ports B, C or D
+
+    static const char PORT_ID = (PIN < 8) ? 'D' : (PIN < 14) ? 'B' : 'C'; //Port letter
+    static const byte BIT = (PIN < 8) ? PIN : (PIN < 14) ? PIN - 8 : PIN - 14; //Bit within port
+    static const byte MASK = 1 << BIT; //Bit mask within port
+
+#ifdef ARDUINO
+    /** @brief  Get output register of port containing pin */
+    static inline volatile uint8_t& Port()
+    {
+        return (PORT_ID == 'D') ? PORTD : (PORT_ID == 'B') ? PORTB : PORTC;
+    }
+
+    /** @brief  Get input register of port containing pin
+    *   @note   Reading this once gives the state of all pins on the port
+    */
+    static inline volatile uint8_t& Input()
+    {
+        return (PORT_ID == 'D') ? PIND : (PORT_ID == 'B') ? PINB : PINC;
+    }
+
+    /** @brief  Get data direction register of port containing pin */
+    static inline volatile uint8_t& Direction()
+    {
+        return (PORT_ID == 'D') ? DDRD : (PORT_ID == 'B') ? DDRB : DDRC;
+    }
+
+    /** @brief  Set output state
+    *   @param  bValue True to set pin high
+    */
+    static inline void Set(bool bValue)
+    {
+        if(bValue)
+            Port() |= MASK;
+        else
+            Port() &= ~MASK;
+    }
+
+    /** @brief  Toggle output state
+    *   @note   Writing one to a bit of the input register toggles the output - a single port write with no read-modify-write
+    */
+    static inline void Toggle()
+    {
+        Input() = MASK;
+    }
+
+    /** @brief  Get input state
+    *   @return <i>bool</i> True if pin is high
+    */
+    static inline bool Get()
+    {
+        return Input() & MASK;
+    }
+#else
+    static inline volatile uint8_t& Port()
+    {
+        return FastPinGetRegister(PORT_ID, 0);
+    }
+
+    static inline volatile uint8_t& Input()
+    {
+        return FastPinGetRegister(PORT_ID, 1);
+    }
+
+    static inline volatile uint8_t& Direction()
+    {
+        return FastPinGetRegister(PORT_ID, 2);
+    }
+
+    static inline void Set(bool bValue)
+    {
+        if(bValue == Get())
+            return;
+        Port() ^= MASK;
+        if(FastPinGetHook())
+            FastPinGetHook()(PIN, bValue);
+    }
+
+    static inline void Toggle()
+    {
+        Set(!Get());
+    }
+
+    static inline bool Get()
+    {
+        return Port() & MASK;
+    }
+#endif // ARDUINO
+};
+
+#endif // FASTIO_H
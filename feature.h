@@ -0,0 +1,40 @@
+/** riban heating controller - compile time feature switches
+*   Each feature defaults to enabled. Build variants define a switch as 0 to remove the feature, with its RAM and flash.
+*   Timing probes default to disabled as they drive a spare pin.
+*/
+#ifndef FEATURE_H
+#define FEATURE_H
+
+#ifndef FEATURE_LCD
+#define FEATURE_LCD 1 //16x2 LCD and buttons user interface
+#endif // FEATURE_LCD
+
+#ifndef FEATURE_SERIAL_HELP
+#define FEATURE_SERIAL_HELP 1 //Serial command help text
+#endif // FEATURE_SERIAL_HELP
+
+#ifndef FEATURE_DEBUG_DUMP
+#define FEATURE_DEBUG_DUMP 1 //"d" EEPROM dump command
+#endif // FEATURE_DEBUG_DUMP
+
+#ifndef FEATURE_SCAN
+#define FEATURE_SCAN 1 //"s" 1-Wire bus scan command
+#endif // FEATURE_SCAN
+
+#ifndef FEATURE_BENCHMARK
+#define FEATURE_BENCHMARK 1 //"B" primitive timing command
+#endif // FEATURE_BENCHMARK
+
+#ifndef FEATURE_DIAG
+#define FEATURE_DIAG 1 //"I" interrupt latency and millis() drift diagnostics (uses Timer2)
+#endif // FEATURE_DIAG
+
+#ifndef FEATURE_JOURNAL
+#define FEATURE_JOURNAL 1 //Log of readings, relay transitions and trace records in external I2C EEPROM (see journal.h)
+#endif // FEATURE_JOURNAL
+
+#ifndef FEATURE_PROBE
+#define FEATURE_PROBE 0 //Logic analyser probe pin toggled at loop phase boundaries (see probe.h)
+#endif // FEATURE_PROBE
+
+#endif // FEATURE_H
@@ -0,0 +1,107 @@
+/** riban heating controller - text formatting
+*   Replaces chains of Print calls with a single buffer per line, avoiding float and per-character virtual calls.
+*/
+
+#include "format.h"
+
+/** @brief  Writes digits of a value with optional sign and padding
+*   @param  pBuffer Pointer to buffer to write to
+*   @param  nValue Magnitude of value
+*   @param  bNegative True to prefix with '-'
+*   @param  nWidth Minimum quantity of characters including sign
+*   @param  cPad Padding character. '0' pads between sign and digits, other characters pad before sign
+*   @return <i>char*</i> Pointer to null terminator
+*/
+static char* FormatDigits(char* pBuffer, unsigned int nValue, bool bNegative, byte nWidth, char cPad)
+{
+    char sDigits[5]; //65535 is longest value
+    byte nDigits = 0;
+    do
+    {
+        sDigits[nDigits++] = '0' + nValue % 10;
+        nValue /= 10;
+    } while(nValue);
+    byte nLength = nDigits + (bNegative ? 1 : 0);
+    if(bNegative && cPad == '0')
+        *pBuffer++ = '-';
+    for(; nWidth > nLength; --nWidth)
+        *pBuffer++ = cPad;
+    if(bNegative && cPad != '0')
+        *pBuffer++ = '-';
+    while(nDigits)
+        *pBuffer++ = sDigits[--nDigits];
+    *pBuffer = 0;
+    return pBuffer;
+}
+
+/** @brief  Formats an unsigned decimal value
+*   @param  pBuffer Pointer to buffer to write to (up to 5 characters or nWidth if larger plus terminator)
+*   @param  nValue Value to format
+*   @param  nWidth Minimum quantity of characters
+*   @param  cPad Padding character
+*   @return <i>char*</i> Pointer to null terminator
+*/
+char* FormatUnsigned(char* pBuffer, unsigned int nValue, byte nWidth, char cPad)
+{
+    return FormatDigits(pBuffer, nValue, false, nWidth, cPad);
+}
+
+/** @brief  Formats a signed decimal value
+*   @param  pBuffer Pointer to buffer to write to (up to 6 characters or nWidth if larger plus terminator)
+*   @param  nValue Value to format
+*   @param  nWidth Minimum quantity of characters including sign
+*   @param  cPad Padding character
+*   @return <i>char*</i> Pointer to null terminator
+*/
+char* FormatSigned(char* pBuffer, int nValue, byte nWidth, char cPad)
+{
+    if(nValue < 0)
+        return FormatDigits(pBuffer, 0U - (unsigned int)nValue, true, nWidth, cPad);
+    return FormatDigits(pBuffer, nValue, false, nWidth, cPad);
+}
+
+/** @brief  Formats a fixed point value, e.g. temperature in C/10
+*   @param  pBuffer Pointer to buffer to write to
+*   @param  nValue Value scaled by 10^nDecimals
+*   @param  nDecimals Quantity of decimal places (1 or 2)
+*   @param  nWidth Minimum quantity of characters including sign and decimal point. Padded with spaces.
+*   @return <i>char*</i> Pointer to null terminator
+*/
+char* FormatFixed(char* pBuffer, int nValue, byte nDecimals, byte nWidth)
+{
+    unsigned int nScale = (nDecimals == 2) ? 100 : 10;
+    bool bNegative = (nValue < 0);
+    unsigned int nMagnitude = bNegative ? 0U - (unsigned int)nValue : nValue;
+    nWidth = (nWidth > nDecimals + 1) ? nWidth - nDecimals - 1 : 0;
+    pBuffer = FormatDigits(pBuffer, nMagnitude / nScale, bNegative, nWidth, ' ');
+    *pBuffer++ = '.';
+    return FormatDigits(pBuffer, nMagnitude % nScale, false, nDecimals, '0');
+}
+
+/** @brief  Formats a byte as two upper case hexadecimal digits
+*   @param  pBuffer Pointer to buffer to write to
+*   @param  nValue Value to format
+*   @return <i>char*</i> Pointer to null terminator
+*/
+char* FormatHex(char* pBuffer, byte nValue)
+{
+    static const char HEX_DIGITS[] = "0123456789ABCDEF";
+    *pBuffer++ = HEX_DIGITS[nValue >> 4];
+    *pBuffer++ = HEX_DIGITS[nValue & 0x0F];
+    *pBuffer = 0;
+    return pBuffer;
+}
+
+/** @brief  Copies a string
+*   @param  pBuffer Pointer to buffer to write to
+*   @param  pString Pointer to string to copy
+*   @param  nMax Maximum quantity of characters to copy (allows fixed length, unterminated fields such as zone name)
+*   @return <i>char*</i> Pointer to null terminator
+*/
+char* FormatString(char* pBuffer, const char* pString, byte nMax)
+{
+    while(nMax-- && *pString)
+        *pBuffer++ = *pString++;
+    *pBuffer = 0;
+    return pBuffer;
+}
@@ -0,0 +1,17 @@
+/** riban heating controller - text formatting
+*   Integer only formatting of values into a caller supplied buffer.
+*   Each function writes at pBuffer, null terminates and returns a pointer to the terminator so that calls may be chained
+*   and the completed line sent to Serial or LCD with a single print.
+*/
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include "Arduino.h"
+
+char* FormatUnsigned(char* pBuffer, unsigned int nValue, byte nWidth = 0, char cPad = ' ');
+char* FormatSigned(char* pBuffer, int nValue, byte nWidth = 0, char cPad = ' ');
+char* FormatFixed(char* pBuffer, int nValue, byte nDecimals, byte nWidth = 0);
+char* FormatHex(char* pBuffer, byte nValue);
+char* FormatString(char* pBuffer, const char* pString, byte nMax = 0xFF);
+
+#endif // FORMAT_H
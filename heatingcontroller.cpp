@@ -6,10 +6,9 @@
 *   Heating pump relay controlled from (Arduino) pin defined by g_nPump
 *   Boiler relay contolled from (Arduino) pin defined by g_nBoiler
 *   DS1307 Real Time Clock I2C buss connected to (Arduino) A4 (SDA) & A5 (SCL)
+*   Zone valve relays driven by two daisy-chained 74HC595 shift registers on (Arduino) pins 11 (SER), 12 (RCLK) & 13 (SRCLK)
 *
 *   Libraries used:
-*       Wire - I2C interface library
-*           TWI/I2C library for Arduino & Wiring  Copyright (c) 2006 Nicholas Zambetti.  All right reserved. GLPL 2.1
 *       OneWire - Dallas one wire protocol interface library
 *           Copyright (c) 2007, Jim Studt  (original old version - many contributors since)
 *           CRC code Copyright (C) 2000 Dallas Semiconductor Corporation, All Rights Reserved.
@@ -21,53 +20,139 @@
 */
 
 #include "Arduino.h"
+#include "control.h"
 #include "heatingcontroller.h"
-#include <Wire.h>
+#include "format.h"
+#include "fastio.h"
+#include "modbus.h"
+#include "shiftreg.h"
+#include "twi.h"
+#include "log.h"
+#include "feature.h"
+#include "ui.h"
+#include "diag.h"
+#include "scratch.h"
+#include "record.h"
+#include "journal.h"
 #include <OneWire.h>
 #include <EEPROM.h>
-#include <LiquidCrystal.h>
 #include <ribanTimer.h>
 
 const unsigned int MAX_SENSORS = 10;
 const unsigned int MAX_EVENTS = 100;
 const unsigned int MAX_SERIAL = 30;
 const int DS1307_I2C_ADDRESS = 0x68;
+const byte DS1307_TIME_REGISTERS = 7; //Seconds, minutes, hours, day of week, day, month, year
 const unsigned int EEPROM_SENSOR_START = 0;
 const unsigned int EEPROM_SENSOR_SIZE = 10;
 const unsigned int EEPROM_ZONE_START = 100;
 const unsigned int EEPROM_ZONE_SIZE = 20;
-const unsigned int EEPROM_EVENT_START = 200;
-const unsigned int EEPROM_EVENT_SIZE = 10;
-const unsigned int TIMEOUT_MENU = 30000; //ms to wait before returning to clock display
-const unsigned int TIMEOUT_EDIT = 10000; //ms to wait before returning to clock display
+const unsigned int EEPROM_SETTINGS_START = 300;
+const unsigned int EEPROM_SETTING_FILTER = 0; //Offset of reading filter EMA shift within settings
+const unsigned int EEPROM_SETTING_MODBUS = 1; //Offset of Modbus slave address within settings
+const unsigned int EEPROM_SETTING_LOG_LEVEL = 2; //Offset of log verbosity within settings
+const unsigned int EEPROM_SETTING_LOG_MASK = 3; //Offset of log category mask within settings
+const unsigned int EEPROM_SETTING_OUTDOOR = 4; //Offset of outdoor sensor index within settings
+const unsigned int EEPROM_SETTING_PRIORITY = 5; //Offset of priority zone flags (2 bytes) within settings
+const unsigned int EEPROM_SETTING_MAX_HOLD = 7; //Offset of maximum priority hold (minutes) within settings
+const unsigned int EEPROM_SETTING_BATCH = 8; //Offset of demand batching enable within settings
+const unsigned int EEPROM_SETTING_TUNE_RATE = 9; //Offset of hysteresis tuning target cycles per hour within settings
+const unsigned int EEPROM_SETTING_TUNE_MIN = 10; //Offset of minimum tuned hysteresis within settings
+const unsigned int EEPROM_SETTING_TUNE_MAX = 11; //Offset of maximum tuned hysteresis within settings
+const unsigned int EEPROM_EVENT_START = 320;
+const unsigned int EEPROM_EVENT_SIZE = 6;
+const byte EEPROM_SENSOR_RECORD = 9; //Bytes of sensor slot used (UID, zone)
+const byte EEPROM_ZONE_RECORD = 20; //Bytes of zone slot used (hysteresis, space, name, compensation curve)
+const byte EEPROM_ZONE_CURVE = 12; //Offset of compensation curve within zone slot
+const byte EEPROM_SETTINGS_SIZE = 20;
+const unsigned int EEPROM_MODEL_START = 920;
+const unsigned int EEPROM_MODEL_SIZE = 4;
+const unsigned int EEPROM_TUNED_START = 960; //Tuned hysteresis of each zone (1 slot per zone)
+const unsigned int EEPROM_BENCHMARK = 1023; //Spare slot written by benchmark so configuration slots are not worn
+const byte EVENT_BLOCK_SIZE = 10; //Quantity of events in each configuration hash block
 const char* DOW[] = {"","Sun","Mon","Tue","Wed","Thu","Fri","Sat"};
-
-const unsigned int PIN_BUTTON_DOWN = A1;
-const unsigned int PIN_BUTTON_UP = A3;
-const unsigned int PIN_BUTTON_OK = A2;
-const unsigned int PIN_LCDD7 = 2;
-const unsigned int PIN_LCDD6 = 3;
-const unsigned int PIN_LCDD5 = 4;
-const unsigned int PIN_LCDD4 = 5;
-const unsigned int PIN_LCDRS = 6;
-const unsigned int PIN_LCDE = 10;
+const byte FILTER_DEFAULT_SHIFT = 2; //Default EMA weight of each new reading (1/2^n)
+const byte FILTER_MAX_SHIFT = 4; //Maximum EMA shift - limits accumulator range and settling time
+const byte SCRATCHPAD_RETRIES = 3; //Maximum re-reads of sensor scratchpad after CRC failure
+const int DS18B20_POWERON = 0x0550; //Raw value held in scratchpad after sensor power-on reset (85C)
+const unsigned int DS18B20_CONVERT_TIME = 750; //Maximum ms for 12-bit temperature conversion
+const unsigned int CONVERT_LEAD = 1000; //ms before minute boundary to start bus-wide temperature conversion
+const byte MODBUS_MAX_ADDRESS = 247;
+const byte TUNE_DEFAULT_MIN = 2; //Default minimum tuned hysteresis (C/10)
+const byte TUNE_DEFAULT_MAX = 30; //Default maximum tuned hysteresis (C/10)
+const byte TUNE_MAX_RATE = 60; //Maximum target cycles per hour
+const byte OUTDOOR_NONE = 0xFF; //No outdoor sensor designated
+const int OUTDOOR_UNKNOWN = -32768; //Outdoor temperature not yet applied to compensation
+const int MODEL_OUTDOOR_DEFAULT = 100; //Outdoor temperature assumed by thermal model without outdoor sensor (C/10)
+const unsigned int MODEL_SAVE_MINUTES = 360; //Minutes between saving changed thermal model coefficients to EEPROM
+const unsigned int JOURNAL_READING_PERIOD = 10; //Minutes between journal records of each sensor's reading
+const unsigned int JOURNAL_FLUSH_PERIOD = 60; //Maximum minutes collected journal records wait to be written
+const signed char CURVE_DEFAULT[CURVE_POINTS * 2] PROGMEM = {-10, 20, 0, 10, 10, 5, 16, 0}; //Default compensation curve: outdoor (C), offset (C/10)
+//Modbus holding register map
+const unsigned int MODBUS_REG_RELAYS = 0; //Bit 0 boiler, bit 1 pump (read only)
+const unsigned int MODBUS_REG_DEMAND = 1; //Bitwise flag of zones calling for heat (read only)
+const unsigned int MODBUS_REG_TIME = 2; //Minutes since 00:00 (read only)
+const unsigned int MODBUS_REG_DAY = 3; //Bitwise flag of day of week. LSB = Sunday (read only)
+const unsigned int MODBUS_REG_SENSOR_QUANT = 4; //Quantity of sensors (read only)
+const unsigned int MODBUS_REG_EVENT_QUANT = 5; //Quantity of events (read only)
+const unsigned int MODBUS_REG_SENSOR_VALUE = 6; //10 registers: sensor value C/100 (read only)
+const unsigned int MODBUS_REG_SETPOINT = 16; //10 registers: zone setpoint C/10
+const unsigned int MODBUS_REG_VALVES = 26; //Bitwise flag of open zone valves (read only)
+typedef char LiveStateFitsOneRead[(MODBUS_REG_VALVES < MODBUS_MAX_READ) ? 1 : -1]; //Registers 0 - 26 are read together
+const unsigned int MODBUS_REG_LOSS = 30; //10 registers: zone heat loss coefficient (see model::nLoss) (read only)
+const unsigned int MODBUS_REG_GAIN = 40; //10 registers: zone heat gain coefficient (see model::nGain) (read only)
+const unsigned int MODBUS_REG_TRANSITIONS = 50; //Quantity of relay transitions (read only)
+const unsigned int MODBUS_REG_STARTS = 51; //Quantity of boiler starts (read only)
+const unsigned int MODBUS_REG_BATCHED = 52; //Quantity of zones that shared a burn instead of calling for heat later (read only)
+const unsigned int MODBUS_REG_SENSOR_ZONE = 100; //10 registers: sensor zone
+const unsigned int MODBUS_REG_HYST = 110; //10 registers: zone hysteresis C/10
+const unsigned int MODBUS_REG_SPACE = 120; //10 registers: 1 if space heating zone, 0 if water
+const unsigned int MODBUS_REG_FILTER = 130; //Reading filter shift
+const unsigned int MODBUS_REG_ADDRESS = 131; //Modbus slave address. 0 returns serial port to text commands
+const unsigned int MODBUS_REG_OUTDOOR = 132; //Outdoor sensor index. 255 for none
+const unsigned int MODBUS_REG_PRIORITY = 133; //Bitwise flag of priority zones
+const unsigned int MODBUS_REG_MAX_HOLD = 134; //Maximum minutes priority zones hold off other zones. 0 to disable priority
+const unsigned int MODBUS_REG_BATCH = 135; //1 to let zones due to call for heat share a burn
+const unsigned int MODBUS_REG_TUNE_RATE = 136; //Hysteresis tuning target cycles per hour. 0 to disable tuning
+const unsigned int MODBUS_REG_TUNE_MIN = 137; //Minimum tuned hysteresis C/10
+const unsigned int MODBUS_REG_TUNE_MAX = 138; //Maximum tuned hysteresis C/10
+const unsigned int MODBUS_REG_OPTIMISE = 139; //Write 1 to optimise events (see OptimiseEvents). Reads 0
+const unsigned int MODBUS_REG_HASH = 140; //Configuration hashes: sensors, zones, settings, events then 10 event blocks (read only)
+const unsigned int MODBUS_REG_EVENT = 200; //4 registers per event: days (0 to delete), minutes since 00:00, zone, setpoint C/10. Append by writing all 4 after last event.
+//Event writes are not optimised automatically (unlike E+) so event indexes stay stable while a host writes a schedule. Host writes MODBUS_REG_OPTIMISE when done.
 
 const unsigned int PIN_ONEWIRE = 7;
 const unsigned int PIN_PUMP = 8;
 const unsigned int PIN_BOILER = 9;
+const unsigned int PIN_VALVE_DATA = 11; //74HC595 serial data (SER)
+const unsigned int PIN_VALVE_LATCH = 12; //74HC595 storage register clock (RCLK)
+const unsigned int PIN_VALVE_CLOCK = 13; //74HC595 shift register clock (SRCLK)
 
 unsigned int g_nSensorQuant;
-unsigned int g_nWaterLowTemp = 80;
-unsigned int g_nWaterHighTemp = 600;
 byte g_nEventQuant;
 OneWire ds(PIN_ONEWIRE);
-byte g_bufferInput[MAX_SERIAL];
+byte* const g_bufferInput = g_bufferModbus; //Text commands share Modbus frame buffer as serial port is in one mode at a time
+typedef char InputFitsModbusBuffer[(MAX_SERIAL <= MODBUS_BUFFER_SIZE) ? 1 : -1];
 byte g_nCursorInput;
-byte g_nSelectedZone = 0xFF;
-bool g_bButtonDown = true;
-bool g_bButtonUp = true;
-bool g_bButtonOk = true;
-bool g_bEdit = false;
+bool g_bTimePending = false; //True when minute boundary reached and clock not yet read
+bool g_bTimeRequested = false; //True whilst minute boundary RTC read is in progress
+bool g_bConverting = false; //True when bus-wide temperature conversion started and not yet read
+unsigned long g_lConvertStart; //Value of millis() when bus-wide conversion started
+byte g_bufferRtc[DS1307_TIME_REGISTERS]; //Raw RTC time registers
+unsigned int g_nHashSensors; //Configuration hash of sensor section
+unsigned int g_nHashZones; //Configuration hash of zone section
+unsigned int g_nHashSettings; //Configuration hash of settings section
+unsigned int g_nHashEvents[MAX_EVENTS / EVENT_BLOCK_SIZE]; //Configuration hash of each block of events
+byte g_nFilterShift = FILTER_DEFAULT_SHIFT; //Reading filter EMA weight (1/2^n). 0 = median only
+byte g_nModbusAddress = 0; //Modbus slave address. 0 for text commands on serial port
+byte g_nLogLevel = LOG_LEVEL; //Runtime log verbosity
+byte g_nLogMask = LOG_ALL; //Bitwise flag of enabled log categories
+byte g_nOutdoorSensor = OUTDOOR_NONE; //Index of sensor measuring outdoor temperature
+int g_nOutdoor = OUTDOOR_UNKNOWN; //Outdoor temperature used for current compensation (C/10)
+unsigned int g_nModelMinutes = 0; //Minutes since thermal models were last saved
+byte g_nTuneRate = 0; //Hysteresis tuning target cycles per hour. 0 = hysteresis fixed as configured
+byte g_nTuneMin = TUNE_DEFAULT_MIN; //Minimum tuned hysteresis (C/10)
+byte g_nTuneMax = TUNE_DEFAULT_MAX; //Maximum tuned hysteresis (C/10)
 
 struct timestamp
 {
@@ -75,29 +160,55 @@ struct timestamp
     byte nDay; //Bitwise flag of day. 1 = Sunday
 };
 
-struct sensor
-{
-    byte address[8]; //UID
-    int nValue; //Current value (C/100)
-    byte nZone; //Zone this sensor measures or contributes to
-};
-
 struct event
 {
-    unsigned int nTime; //Seconds since 00:00:00 Sunday
+    unsigned int nTime; //Minutes since 00:00
     byte nDays; //Bitwise flag of which days of week. LSB = Sunday
     byte nZone; //Zone this event relates to
-    int nValue; //Temperature trigger value
+    int nValue; //Set-point (C/10)
+};
+
+//Record field descriptors: persisted fields in parse order with EEPROM offsets, then runtime fields shown in listings
+const field SENSOR_FIELDS[] PROGMEM =
+{
+    FIELD("UID", FIELD_HEX, 8, 0, sensor, address, 0),
+    FIELD("Zone", FIELD_BYTE, 0, 0, sensor, nZone, 8),
+    FIELD("Temp", FIELD_INT, 0, 2, sensor, nValue, FIELD_RUNTIME),
+    FIELD("Retries", FIELD_UINT, 0, 0, sensor, nCrcRetries, FIELD_RUNTIME),
+    FIELD("Errors", FIELD_UINT, 0, 0, sensor, nCrcErrors, FIELD_RUNTIME),
+    FIELD("Resets", FIELD_UINT, 0, 0, sensor, nPowerOn, FIELD_RUNTIME)
+};
+const byte SENSOR_FIELD_QUANT = sizeof(SENSOR_FIELDS) / sizeof(field);
+
+const field ZONE_FIELDS[] PROGMEM =
+{
+    FIELD("Hyst", FIELD_BYTE, 0, 1, zone, nHyst, 0),
+    FIELD("Space", FIELD_BOOL, 0, 0, zone, bSpace, 1),
+    FIELD("Name", FIELD_TEXT, 10, 0, zone, sName, 2),
+    FIELD("Setpoint", FIELD_INT, 0, 1, zone, nSetpoint, FIELD_RUNTIME),
+    FIELD("Comp", FIELD_INT, 0, 1, zone, nCompensation, FIELD_RUNTIME),
+    FIELD("On", FIELD_BOOL, 0, 0, zone, bOn, FIELD_RUNTIME)
+};
+const byte ZONE_FIELD_QUANT = sizeof(ZONE_FIELDS) / sizeof(field);
+const unsigned int ZONE_FIELD_HYST = 1; //Bitwise flag of hysteresis within ZONE_FIELDS
+
+const field EVENT_FIELDS[] PROGMEM =
+{
+    FIELD("Days", FIELD_DAYS, 0, 0, event, nDays, 0),
+    FIELD("Time", FIELD_TIME, 0, 0, event, nTime, 1),
+    FIELD("Zone", FIELD_BYTE, 0, 0, event, nZone, 3),
+    FIELD("Setpoint", FIELD_INT, 0, 1, event, nValue, 4)
 };
+const byte EVENT_FIELD_QUANT = sizeof(EVENT_FIELDS) / sizeof(field);
 
-struct zone
+#if FEATURE_BENCHMARK
+struct timing
 {
-    int nSetpoint; //Temperature set-point (C/10)
-    byte nHyst; //Hysteresis value (C/10)
-    bool bOn; //True if calling for heat
-    bool bSpace; //True if space heating zone (room, not water cylinder, requires pump)
-    char sName[10]; //Name of zone
+    unsigned long lMin; //Shortest duration (us)
+    unsigned long lMax; //Longest duration (us)
+    unsigned long lTotal; //Sum of durations (us)
 };
+#endif // FEATURE_BENCHMARK
 
 timestamp g_tsNow; //Current time
 timestamp g_tsNextEvent; //Number of minutes since 00:00 Sunday of next event
@@ -106,9 +217,11 @@ event g_events[MAX_EVENTS]; //reserve space for maximum number of events
 zone g_zones[10]; //Current temperature set-point for each zone
 
 Timer timerMinute; //Instantiate a timer to find minute boundaries
-Timer timerDebounce; //Instantiate a button debounce timer
-Timer timerDisplayTimeout; //Instantiate a timer for display (edit mode) timeout
-LiquidCrystal g_lcd(PIN_LCDRS, PIN_LCDE, PIN_LCDD4, PIN_LCDD5, PIN_LCDD6, PIN_LCDD7);
+Timer timerConvert; //Instantiate a timer to start temperature conversion ahead of minute boundary
+ShiftRegister<PIN_VALVE_DATA, PIN_VALVE_CLOCK, PIN_VALVE_LATCH, 2> g_valves; //Zone valve relays - one output per zone
+scheduler g_scheduler; //Zone demand scheduler
+model g_models[10]; //Thermal model of each zone
+tuner g_tuners[10]; //Hysteresis tuner of each zone
 
 /** @brief  Initialisation */
 void setup()
@@ -116,85 +229,151 @@ void setup()
     // initialize the digital pin as an output.
     pinMode(PIN_BOILER, OUTPUT);
     pinMode(PIN_PUMP, OUTPUT);
-    pinMode(PIN_BUTTON_OK, INPUT_PULLUP);
-    pinMode(PIN_BUTTON_DOWN, INPUT_PULLUP);
-    pinMode(PIN_BUTTON_UP, INPUT_PULLUP);
+    g_valves.Begin(); //Close all zone valves
     Serial.begin(9600);
-    Serial.println("Starting...");
-    Wire.begin();
+    LOG_IF(LOG_INFO, LOG_SYSTEM)
+        Serial.println(F("Starting..."));
+    TwiBegin();
     g_tsNextEvent.nDay = 0;
     g_tsNextEvent.nTime = 0;
     ReadConfig();
-    g_lcd.begin(16, 2); //initialise 16x2 LCD
+    UiBegin();
+#if FEATURE_JOURNAL
+    if(JournalBegin())
+    {
+        getTime(false);
+        JournalAdd(JOURNAL_TRACE, JOURNAL_TRACE_START, GetMinuteOfWeek(), (g_lJournalSequence < JOURNAL_PAGES) ? g_lJournalSequence : JOURNAL_PAGES);
+    }
+#endif // FEATURE_JOURNAL
+    DiagBegin();
+    ProbeBegin();
     timerMinute.start(1000, true); //start minute timer to trigger on first second to start minute sync promptly
 }
 
 /** Main program loop */
 void loop()
 {
+    if(timerConvert.IsTriggered())
+    {
+        DiagPhase(PHASE_SENSOR);
+        StartConversion(); //Readings are ready when minute boundary arrives
+        DiagPhase(PHASE_IDLE);
+    }
     if(timerMinute.IsTriggered())
+        g_bTimePending = true;
+    if(g_bTimePending && !g_bTimeRequested)
+        g_bTimeRequested = requestTime(); //Read clock in background (retry next loop if bus busy)
+
+    if(g_bTimeRequested && TwiStatus() != TWI_BUSY)
     {
         //Update clock
-        getTime(true);
+        g_bTimePending = false;
+        g_bTimeRequested = false;
+        unsigned long lStart = millis();
+        DiagPhase(PHASE_CLOCK);
+        byte nSecond = 0;
+        if(TwiStatus() == TWI_OK)
+        {
+            nSecond = decodeTime(true, LOG_ENABLED(LOG_DEBUG, LOG_SCHEDULE));
+            DiagClock(g_tsNow.nDay, g_tsNow.nTime, nSecond);
+        }
+        DiagPhase(PHASE_SCHEDULE);
         if(g_tsNextEvent.nTime == g_tsNow.nTime && (g_tsNextEvent.nDay & g_tsNow.nDay))
             ProcessEvents();
-        //Update temperature readings
-        bool bPump = false;
-        bool bBoiler = false;
+        //Update temperature readings from conversion started before boundary
+        DiagPhase(PHASE_SENSOR);
+        if(!g_bConverting)
+            StartConversion(); //Not pre-armed, e.g. first minute after start
+        WaitConversion();
+        g_bConverting = false;
+        if(g_nOutdoorSensor < g_nSensorQuant)
+        {
+            ProbeSensor();
+            bool bOutdoor = GetTemperature((unsigned int)g_nOutdoorSensor, false);
+            ProbeSensor();
+            if(bOutdoor)
+                UpdateCompensation();
+        }
+        int nOutdoor = (g_nOutdoor == OUTDOOR_UNKNOWN) ? MODEL_OUTDOOR_DEFAULT : g_nOutdoor;
+        int nZoneValue[10]; //First reading of each zone feeds its thermal model
+        unsigned int nZoneRead = 0; //Bitwise flag of zones with a reading
         for(unsigned int nSensor = 0; nSensor < g_nSensorQuant; nSensor++)
         {
-            GetTemperature(nSensor);
-            if(g_zones[g_sensors[nSensor].nZone].nSetpoint < g_sensors[nSensor].nValue)
-                g_zones[g_sensors[nSensor].nZone].bOn = false; //Gone over setpoint
-
-            if(g_zones[g_sensors[nSensor].nZone].nSetpoint - g_zones[g_sensors[nSensor].nZone].nHyst > g_sensors[nSensor].nValue / 10)
-                g_zones[g_sensors[nSensor].nZone].bOn = true; //Gone below hysteresis point
-            bBoiler |= g_zones[g_sensors[nSensor].nZone].bOn; //Contributes to call for heat
-            if(g_zones[g_sensors[nSensor].nZone].bSpace)
-                bPump |= g_zones[g_sensors[nSensor].nZone].bOn; //Contributes to call for heat (not zone 0 - water sensor)
+            if(nSensor == g_nOutdoorSensor)
+                continue; //Outdoor sensor does not belong to a zone
+            ProbeSensor();
+            GetTemperature(nSensor, false);
+            ProbeSensor();
+            byte nZone = g_sensors[nSensor].nZone;
+            if(nZone > 9)
+                continue; //Invalid zone loaded from EEPROM
+            UpdateZone(&g_zones[nZone], g_sensors[nSensor].nValue);
+            if(!(nZoneRead & (1 << nZone)))
+            {
+                nZoneValue[nZone] = g_sensors[nSensor].nValue;
+                nZoneRead |= 1 << nZone;
+            }
         }
-
-        digitalWrite(PIN_BOILER, bBoiler);
-        digitalWrite(PIN_PUMP, bPump);
-
-        unsigned int nSecs = 60 - getTime(false); //!@todo Is there a way to avoid calling getTime twice? First is to feed this minute's processing. Second is to estimate next minute boundary
-        timerMinute.start((nSecs) * 1000, true); //Restart timer to hit next minute boundary
-    }
-
-    if(Serial.available())
-        ReadSerial();
-
-
-    if(!timerDebounce.IsTriggered())
-    {
-        bool bState = digitalRead(PIN_BUTTON_UP);
-        if(g_bButtonUp != bState)
+        if(g_tsNow.nTime % JOURNAL_READING_PERIOD == 0)
+            for(byte nSensor = 0; nSensor < g_nSensorQuant; ++nSensor)
+                JournalAdd(JOURNAL_READING, nSensor, GetMinuteOfWeek(), g_sensors[nSensor].nValue);
+        DiagPhase(PHASE_CONTROL);
+        for(byte nZone = 0; nZone < 10; ++nZone)
+            if(nZoneRead & (1 << nZone))
+                AnticipateZone(&g_zones[nZone], &g_models[nZone], nZoneValue[nZone], nOutdoor);
+        if(g_nTuneRate)
         {
-            g_bButtonUp = bState;
-            timerDebounce.start(30, true);
-            if(!g_bButtonUp)
-                OnButtonUpDown(true);
+            for(byte nZone = 0; nZone < 10; ++nZone)
+                if((nZoneRead & (1 << nZone)) && TuneZone(&g_tuners[nZone], &g_zones[nZone], nZoneValue[nZone], g_nTuneRate, g_nTuneMin, g_nTuneMax))
+                    SaveTunedHyst(nZone);
         }
-        bState = digitalRead(PIN_BUTTON_DOWN);
-        if(g_bButtonDown != bState)
+
+        ScheduleDemand(&g_scheduler, g_zones, 10);
+        bool bBoiler = g_scheduler.bBoiler;
+        bool bPump = g_scheduler.bPump; //Space heating zones only
+        unsigned int nValves = g_valves.Read();
+        g_valves.Write(g_scheduler.nValves); //Open valve of each zone scheduled for heat
+        for(byte nZone = 0; nZone < 10; ++nZone)
+            if(nZoneRead & (1 << nZone))
+                SampleModel(&g_models[nZone], nZoneValue[nZone], nOutdoor, bBoiler && (g_scheduler.nValves & (1 << nZone)));
+        if(++g_nModelMinutes >= MODEL_SAVE_MINUTES)
         {
-            g_bButtonDown = bState;
-            timerDebounce.start(30, true);
-            if(!g_bButtonDown)
-                OnButtonUpDown(false);
+            g_nModelMinutes = 0;
+            SaveModels();
         }
-        bState = digitalRead(PIN_BUTTON_OK);
-        if(g_bButtonOk != bState)
+        LOG_IF(LOG_INFO, LOG_CONTROL)
         {
-            g_bButtonOk = bState;
-            timerDebounce.start(30, true);
-            OnButtonOk(g_bButtonOk);
+            if(bBoiler != FastPin<PIN_BOILER>::Get() || bPump != FastPin<PIN_PUMP>::Get())
+            {
+                Serial.print(F("Boiler="));
+                Serial.print(bBoiler);
+                Serial.print(F(" Pump="));
+                Serial.println(bPump);
+            }
         }
+        if(nValves != g_scheduler.nValves || bBoiler != FastPin<PIN_BOILER>::Get() || bPump != FastPin<PIN_PUMP>::Get())
+            JournalAdd(JOURNAL_RELAY, (bBoiler ? 1 : 0) | (bPump ? 2 : 0), GetMinuteOfWeek(), g_scheduler.nValves);
+        FastPin<PIN_BOILER>::Set(bBoiler);
+        FastPin<PIN_PUMP>::Set(bPump);
+        if(g_tsNow.nTime % JOURNAL_FLUSH_PERIOD == 0)
+            JournalFlush(); //Limit records lost at power failure
+
+        long lWait = (60 - nSecond) * 1000L - (millis() - lStart); //Time to next minute boundary allowing for processing time
+        if(lWait < 1)
+            lWait = 1;
+        timerMinute.start(lWait, true); //Restart timer to hit next minute boundary
+        timerConvert.start((lWait > (long)CONVERT_LEAD) ? lWait - CONVERT_LEAD : 1, true);
     }
-    if(timerDisplayTimeout.IsTriggered())
-    {
-        ToggleEdit();
-    }
+
+    DiagPhase(PHASE_SERIAL);
+    if(g_nModbusAddress)
+        ModbusPoll(g_nModbusAddress);
+    else if(Serial.available())
+        ReadSerial();
+
+    DiagPhase(PHASE_LCD);
+    UiPoll();
+    DiagPhase(PHASE_IDLE);
 }
 
 /** Reads configuration from EEPROM
@@ -202,54 +381,148 @@ void loop()
       Offset  Use
       0-7     UID (Set first byte to zero to clear sensor configuration)
       8       Zone
-    Slots 100 - 1099 event configuration (10 slots per event):
+    Slots 100 - 299 zone configuration (20 slots per zone)
+      Offset  Use
+      0       Hysteresis (C*10 below setpoint to turn off)
+      1       Space (True if space heating. False if water heating. Not sure if this is used! Maybe for toggling heat / water?)
+      2       Name (10 chars)
+      12      Compensation curve (4 breakpoints of outdoor temperature C, set-point offset C/10)
+    Slots 300 - 319 controller settings
+      Offset  Use
+      0       Reading filter EMA shift (0xFF = default)
+      1       Modbus slave address (0 or 0xFF = text commands)
+      2       Log verbosity (0xFF = default)
+      3       Log category mask
+      4       Outdoor sensor index (0xFF = none)
+      5-6     Priority zone flags (0xFFFF = water zones)
+      7       Maximum priority hold minutes (0 or 0xFF = priority disabled)
+      8       Demand batching (1 = enabled, 0 or 0xFF = disabled)
+      9       Hysteresis tuning target cycles per hour (0 or 0xFF = disabled)
+      10      Minimum tuned hysteresis C/10 (0xFF = default)
+      11      Maximum tuned hysteresis C/10 (0xFF = default)
+    Slots 320 - 919 event configuration (6 slots per event):
       Offset  Use
       0       Day of week (Set to zero to disable event)
       1-2     Timestamp
       3       Zone
       4-5     Temperature value
-    Slots 1100 - 1219 zone configuration (20 slots per zone)
+    Slots 920 - 959 learned thermal model (4 slots per zone, not part of configuration hashes):
       Offset  Use
-      0       Hysteresis (C*10 below setpoint to turn off)
-      1       Space (True if space heating. False if water heating. Not sure if this is used! Maybe for toggling heat / water?)
-      2       Name (10 chars)
+      0-1     Heat loss coefficient (0xFFFF = not learned)
+      2-3     Heat gain coefficient
+    Slots 960 - 969 settled tuned hysteresis (1 slot per zone, not part of configuration hashes):
+      Offset  Use
+      0       Hysteresis C/10 (0xFF = not settled)
+    Slot 1023 benchmark scratch (rewritten with its own content by each benchmark run)
 */
 void ReadConfig()
 {
-    Serial.println("Reading configuration...");
+    //Get settings first so that logging and serial port mode apply to remaining configuration
+    g_nFilterShift = EEPROM.read(EEPROM_SETTINGS_START + EEPROM_SETTING_FILTER);
+    if(g_nFilterShift > FILTER_MAX_SHIFT)
+        g_nFilterShift = FILTER_DEFAULT_SHIFT; //Setting not programmed
+    g_nModbusAddress = EEPROM.read(EEPROM_SETTINGS_START + EEPROM_SETTING_MODBUS);
+    if(g_nModbusAddress > MODBUS_MAX_ADDRESS)
+        g_nModbusAddress = 0; //Setting not programmed
+    g_nLogLevel = EEPROM.read(EEPROM_SETTINGS_START + EEPROM_SETTING_LOG_LEVEL);
+    if(g_nLogLevel > LOG_DEBUG)
+    {
+        g_nLogLevel = LOG_LEVEL; //Setting not programmed
+        g_nLogMask = LOG_ALL;
+    }
+    else
+        g_nLogMask = EEPROM.read(EEPROM_SETTINGS_START + EEPROM_SETTING_LOG_MASK);
+    g_nOutdoorSensor = EEPROM.read(EEPROM_SETTINGS_START + EEPROM_SETTING_OUTDOOR);
+    g_scheduler.nMaxHold = EEPROM.read(EEPROM_SETTINGS_START + EEPROM_SETTING_MAX_HOLD);
+    if(g_scheduler.nMaxHold == 0xFF)
+        g_scheduler.nMaxHold = 0; //Setting not programmed so priority disabled
+    g_scheduler.bBatch = (EEPROM.read(EEPROM_SETTINGS_START + EEPROM_SETTING_BATCH) == 1); //Disabled if not programmed
+    g_nTuneRate = EEPROM.read(EEPROM_SETTINGS_START + EEPROM_SETTING_TUNE_RATE);
+    if(g_nTuneRate > TUNE_MAX_RATE)
+        g_nTuneRate = 0; //Setting not programmed
+    g_nTuneMin = EEPROM.read(EEPROM_SETTINGS_START + EEPROM_SETTING_TUNE_MIN);
+    if(g_nTuneMin == 0xFF)
+        g_nTuneMin = TUNE_DEFAULT_MIN; //Setting not programmed
+    g_nTuneMax = EEPROM.read(EEPROM_SETTINGS_START + EEPROM_SETTING_TUNE_MAX);
+    if(g_nTuneMax == 0xFF)
+        g_nTuneMax = TUNE_DEFAULT_MAX; //Setting not programmed
+    g_nOutdoor = OUTDOOR_UNKNOWN;
+
+    LOG_IF(LOG_INFO, LOG_SYSTEM)
+        Serial.println(F("Reading configuration..."));
     //Get sensor configuration
     for(g_nSensorQuant = 0; g_nSensorQuant < MAX_SENSORS; g_nSensorQuant++)
     {
         if(EEPROM.read(g_nSensorQuant * EEPROM_SENSOR_SIZE + EEPROM_SENSOR_START) == 0)
             break; //Sensor not configured
-        for(unsigned int i = 0; i < 8; ++i)
+        LoadRecord(g_nSensorQuant * EEPROM_SENSOR_SIZE + EEPROM_SENSOR_START, EEPROM_SENSOR_RECORD, SENSOR_FIELDS, SENSOR_FIELD_QUANT, &g_sensors[g_nSensorQuant]);
+        if(g_sensors[g_nSensorQuant].nZone > 9)
         {
-            g_sensors[g_nSensorQuant].address[i] = EEPROM.read(g_nSensorQuant * EEPROM_SENSOR_SIZE + EEPROM_SENSOR_START + i);
+            LOG_IF(LOG_WARN, LOG_SYSTEM)
+            {
+                Serial.print(F("Sensor "));
+                Serial.print(g_nSensorQuant);
+                Serial.println(F(" has invalid zone and is not used for control"));
+            }
         }
-        g_sensors[g_nSensorQuant].nZone = EEPROM.read(g_nSensorQuant * EEPROM_SENSOR_SIZE + EEPROM_SENSOR_START + 8);
     }
-    Serial.print(g_nSensorQuant);
-    Serial.println(" sensors configured");
+    LOG_IF(LOG_INFO, LOG_SYSTEM)
+    {
+        Serial.print(g_nSensorQuant);
+        Serial.println(F(" sensors configured"));
+    }
 
     //Get event configuration
     for(g_nEventQuant = 0; g_nEventQuant < MAX_EVENTS; g_nEventQuant++)
     {
-        g_events[g_nEventQuant].nDays = EEPROM.read(g_nEventQuant * EEPROM_EVENT_SIZE + EEPROM_EVENT_START);
-        if(0 == g_events[g_nEventQuant].nDays)
+        if(0 == EEPROM.read(g_nEventQuant * EEPROM_EVENT_SIZE + EEPROM_EVENT_START))
             break; //Event not configured and expect all events to be stored contiguously
-        g_events[g_nEventQuant].nTime = (EEPROM.read(g_nEventQuant * EEPROM_EVENT_SIZE + EEPROM_EVENT_START + 1) << 8) | EEPROM.read(g_nEventQuant * EEPROM_EVENT_SIZE + EEPROM_EVENT_START + 2);
-        g_events[g_nEventQuant].nZone = EEPROM.read(g_nEventQuant * EEPROM_EVENT_SIZE + EEPROM_EVENT_START + 3);
-        g_events[g_nEventQuant].nValue = (EEPROM.read(g_nEventQuant * EEPROM_EVENT_SIZE + EEPROM_EVENT_START + 4) << 8) | EEPROM.read(g_nEventQuant * EEPROM_EVENT_SIZE + EEPROM_EVENT_START + 5);
+        LoadRecord(g_nEventQuant * EEPROM_EVENT_SIZE + EEPROM_EVENT_START, EEPROM_EVENT_SIZE, EVENT_FIELDS, EVENT_FIELD_QUANT, &g_events[g_nEventQuant]);
+    }
+    LOG_IF(LOG_INFO, LOG_SYSTEM)
+    {
+        Serial.print(g_nEventQuant);
+        Serial.println(F(" events configured"));
     }
-    Serial.print(g_nEventQuant);
-    Serial.println(" events configured");
 
     for(unsigned int nZone = 0; nZone < 10; nZone++)
     {
-        g_zones[nZone].nHyst = EEPROM.read(nZone * EEPROM_ZONE_SIZE + EEPROM_ZONE_START);
-        g_zones[nZone].bSpace = (EEPROM.read(nZone * EEPROM_ZONE_SIZE + EEPROM_ZONE_START + 1) == 1);
-        for(unsigned int i = 0; i < 10; ++i)
-            g_zones[nZone].sName[i] = EEPROM.read(nZone * EEPROM_ZONE_SIZE + EEPROM_ZONE_START + 2 + i);
+        LoadRecord(nZone * EEPROM_ZONE_SIZE + EEPROM_ZONE_START, EEPROM_ZONE_CURVE, ZONE_FIELDS, ZONE_FIELD_QUANT, &g_zones[nZone]);
+        byte nTuned = EEPROM.read(nZone + EEPROM_TUNED_START);
+        if(g_nTuneRate && nTuned >= g_nTuneMin && nTuned <= g_nTuneMax)
+            g_zones[nZone].nHyst = nTuned; //Start from settled value
+    }
+    g_scheduler.nPriority = (EEPROM.read(EEPROM_SETTINGS_START + EEPROM_SETTING_PRIORITY) << 8) | EEPROM.read(EEPROM_SETTINGS_START + EEPROM_SETTING_PRIORITY + 1);
+    if(g_scheduler.nPriority == 0xFFFF)
+    {
+        //Setting not programmed so hot water takes priority if a maximum hold is set
+        g_scheduler.nPriority = 0;
+        for(byte nZone = 0; nZone < 10; ++nZone)
+            if(!g_zones[nZone].bSpace)
+                g_scheduler.nPriority |= 1 << nZone;
+    }
+    for(byte nZone = 0; nZone < 10; ++nZone)
+    {
+        unsigned int nAddress = nZone * EEPROM_MODEL_SIZE + EEPROM_MODEL_START;
+        unsigned int nLoss = (EEPROM.read(nAddress) << 8) | EEPROM.read(nAddress + 1);
+        unsigned int nGain = (EEPROM.read(nAddress + 2) << 8) | EEPROM.read(nAddress + 3);
+        if(nLoss != 0xFFFF)
+            SeedModel(&g_models[nZone], nLoss, nGain);
+    }
+
+    //Build configuration hashes
+    g_nHashSensors = 0;
+    for(byte nSensor = 0; nSensor < MAX_SENSORS; ++nSensor)
+        g_nHashSensors ^= RecordCrc(nSensor * EEPROM_SENSOR_SIZE + EEPROM_SENSOR_START, EEPROM_SENSOR_RECORD, nSensor, true);
+    g_nHashZones = 0;
+    for(byte nZone = 0; nZone < 10; ++nZone)
+        g_nHashZones ^= RecordCrc(nZone * EEPROM_ZONE_SIZE + EEPROM_ZONE_START, EEPROM_ZONE_RECORD, nZone, false);
+    g_nHashSettings = RecordCrc(EEPROM_SETTINGS_START, EEPROM_SETTINGS_SIZE, 0, false);
+    for(byte nEvent = 0; nEvent < MAX_EVENTS; ++nEvent)
+    {
+        if(nEvent % EVENT_BLOCK_SIZE == 0)
+            g_nHashEvents[nEvent / EVENT_BLOCK_SIZE] = 0;
+        g_nHashEvents[nEvent / EVENT_BLOCK_SIZE] ^= RecordCrc(nEvent * EEPROM_EVENT_SIZE + EEPROM_EVENT_START, EEPROM_EVENT_SIZE, nEvent, true);
     }
 }
 
@@ -290,12 +563,12 @@ void ParseSerial()
             // Format S aaaaaaaaaaaaaaaa b
             // aaaaaaaaaaaaaaaa = sensor UID in hexadecimal
             // b = sensor zone
-            byte data[8];
-            for(unsigned int i = 0; i < 8; i++)
-            {
-                data[i] = (CharToHex(g_bufferInput[2 + i * 2]) << 8) + CharToHex(g_bufferInput[3 + i * 2]);
-            }
-            AddSensor(data, *(g_bufferInput + 19) - 48);
+            sensor sensorNew;
+            if(ParseRecord((const char*)g_bufferInput + 1, g_nCursorInput - 1, SENSOR_FIELDS, SENSOR_FIELD_QUANT, &sensorNew) < 2)
+                return;
+            if(sensorNew.nZone > 9)
+                return;
+            AddSensor(sensorNew.address, sensorNew.nZone);
             return;
         }
         else
@@ -305,19 +578,10 @@ void ParseSerial()
             Serial.println(g_nSensorQuant);
             for(unsigned int nSensor = 0; nSensor < g_nSensorQuant; ++nSensor)
             {
-                Serial.print("Sensor [");
-                for(unsigned int i = 0; i < 8; i++)
-                {
-                    if(g_sensors[nSensor].address[i] < 0x10)
-                        Serial.print("0");
-                    Serial.print(g_sensors[nSensor].address[i], HEX);
-                }
-                Serial.print("] Zone ");
-                Serial.print(g_sensors[nSensor].nZone);
-                Serial.print(". Temp=");
-                float fTemp = g_sensors[nSensor].nValue / 100;
-                Serial.print(fTemp);
-                Serial.println("C");
+                Serial.print(nSensor);
+                Serial.print(": ");
+                PrintRecord(SENSOR_FIELDS, SENSOR_FIELD_QUANT, &g_sensors[nSensor]);
+                Serial.println();
             }
         }
         break;
@@ -347,13 +611,13 @@ void ParseSerial()
             if(g_nEventQuant >= MAX_EVENTS)
                 return;
             //Add event
-            byte nDays = (CharToHex(g_bufferInput[3]) << 4) + CharToHex(g_bufferInput[4]);
-            unsigned int nTime = (g_bufferInput[6] - 48) * 600 + (g_bufferInput[7] - 48) * 60 + (g_bufferInput[9] - 48) * 10 + g_bufferInput[10] - 48;
-            byte nZone = g_bufferInput[12] - 48;
-            int nValue = (g_bufferInput[15] - 48) * 100 + (g_bufferInput[16] - 48) * 10 + g_bufferInput[17] - 48;
-            if(g_bufferInput[14] == '-')
-                nValue = -nValue;
-            AddEvent(nZone, nDays, nTime, nValue);
+            event eventNew;
+            if(ParseRecord((const char*)g_bufferInput + 2, g_nCursorInput - 2, EVENT_FIELDS, EVENT_FIELD_QUANT, &eventNew) < EVENT_FIELD_QUANT)
+                return;
+            if(eventNew.nDays == 0 || eventNew.nZone > 9)
+                return;
+            AddEvent(eventNew.nZone, eventNew.nDays, eventNew.nTime, eventNew.nValue);
+            ReportOptimiseEvents(OptimiseEvents());
             ProcessEvents();
         }
         else
@@ -364,28 +628,8 @@ void ParseSerial()
             {
                 Serial.print(nEvent);
                 Serial.print(": ");
-                byte nHours = g_events[nEvent].nTime / 60;
-                byte nMinutes = g_events[nEvent].nTime - (nHours * 60);
-                Serial.print(nHours);
-                Serial.print(":");
-                if(nMinutes < 10)
-                    Serial.print("0");
-                Serial.print(nMinutes);
-                Serial.print(" ");
-                byte nFlag = 2;
-                for(byte nDow = 1; nDow < 8; nDow++)
-                {
-                    if(g_events[nEvent].nDays & nFlag)
-                    {
-                        Serial.print(DOW[nDow]);
-                        Serial.print(" ");
-                    }
-                    nFlag = nFlag << 1;
-                }
-                Serial.print("Zone=");
-                Serial.print(g_events[nEvent].nZone);
-                Serial.print(" Setpoint=");
-                Serial.println(float(g_events[nEvent].nValue)/10);
+                PrintRecord(EVENT_FIELDS, EVENT_FIELD_QUANT, &g_events[nEvent]);
+                Serial.println();
             }
             Serial.print("Next event at ");
             Serial.print(g_tsNextEvent.nDay);
@@ -401,16 +645,12 @@ void ParseSerial()
             byte nZone = (g_bufferInput[2] - 48);
             if(nZone > 9)
                 return; //Only handle zones 0 - 9
-            g_zones[nZone].nHyst = (g_bufferInput[4] - 48) * 10;
-            g_zones[nZone].nHyst += (g_bufferInput[5] - 48);
-            g_zones[nZone].bSpace = (g_bufferInput[7] != 48);
+            zone zoneNew = g_zones[nZone];
             for(unsigned int i = 0; i < 10; i++)
-            {
-                if(i + 9 < g_nCursorInput)
-                    g_zones[nZone].sName[i] = g_bufferInput[9 + i];
-                else
-                    g_zones[nZone].sName[i] = ' ';
-            }
+                zoneNew.sName[i] = ' '; //Name is optional
+            if(ParseRecord((const char*)g_bufferInput + 3, g_nCursorInput - 3, ZONE_FIELDS, ZONE_FIELD_QUANT, &zoneNew) < 2)
+                return;
+            g_zones[nZone] = zoneNew;
             SaveZone(nZone);
         }
         else
@@ -419,15 +659,9 @@ void ParseSerial()
             for (unsigned int nZone = 0; nZone < 10; nZone++)
             {
                 Serial.print(nZone);
-                Serial.print("  ");
-                Serial.print(float(g_zones[nZone].nSetpoint) / 10);
-                Serial.print("C Hyst=");
-                Serial.print(float(g_zones[nZone].nHyst) / 10);
-                Serial.print(g_zones[nZone].bSpace?" Space ":" Water ");
-                Serial.print(g_zones[nZone].bOn?" On ":" Off ");
-                for(unsigned int i = 0; i < 10; i++)
-                    Serial.print(g_zones[nZone].sName[i]);
-                Serial.println();
+                Serial.print(": ");
+                PrintRecord(ZONE_FIELDS, ZONE_FIELD_QUANT, &g_zones[nZone]);
+                Serial.println((g_valves.Read() & (1 << nZone))?"Open":"Shut");
             }
         }
         break;
@@ -460,7 +694,14 @@ void ParseSerial()
             nYear += g_bufferInput[20] - 48;
             setDate(nDow, nDay, nMonth, nYear);
         }
-        getTime(true);
+        getTime(true, true);
+        if(g_nTwiErrors || g_nTwiTimeouts)
+        {
+            Serial.print("I2C errors=");
+            Serial.print(g_nTwiErrors);
+            Serial.print(" timeouts=");
+            Serial.println(g_nTwiTimeouts);
+        }
         break;
     case 'C':
         //Clear
@@ -473,6 +714,9 @@ void ParseSerial()
             g_nSensorQuant = 0;
             for(unsigned int i = 0; i < MAX_SENSORS; i++)
                 EEPROM.write(i * EEPROM_SENSOR_SIZE + EEPROM_SENSOR_START, 0);
+            g_nHashSensors = 0; //Unconfigured records do not contribute to hash
+            if(g_nOutdoorSensor != OUTDOOR_NONE)
+                SetOutdoorSensor(OUTDOOR_NONE); //Otherwise next sensor added at that index would become outdoor sensor
         }
         else if(g_bufferInput[1] == 'E')
         {
@@ -482,6 +726,8 @@ void ParseSerial()
             g_tsNextEvent.nTime = 0;
             for(unsigned int i = 0; i < MAX_EVENTS; i++)
                 EEPROM.write(i * EEPROM_EVENT_SIZE + EEPROM_EVENT_START, 0x00);
+            for(unsigned int i = 0; i < MAX_EVENTS / EVENT_BLOCK_SIZE; i++)
+                g_nHashEvents[i] = 0;
         }
         else if(g_bufferInput[1] == 'Z')
         {
@@ -495,13 +741,251 @@ void ParseSerial()
                 for(unsigned int i = 0; i < 10; ++i)
                     g_zones[nZone].sName[i] = ' ';
                 SaveZone(nZone);
+                for(byte nPoint = 0; nPoint < CURVE_POINTS; ++nPoint)
+                    SaveCurvePoint(nZone, nPoint, -1, -1);
             }
         }
         break;
+    case 'F':
+        //Filter
+        //F n - Set reading filter moving average weight to 1/2^n (0 = median only)
+        if(g_nCursorInput >= 3)
+        {
+            byte nShift = g_bufferInput[2] - 48;
+            if(nShift > FILTER_MAX_SHIFT)
+                return;
+            SetFilterShift(nShift);
+        }
+        Serial.print("Filter shift=");
+        Serial.println(g_nFilterShift);
+        break;
+    case 'M':
+        //Modbus
+        //M aaa - Switch serial port to Modbus RTU slave with address aaa (1-247)
+        if(g_nCursorInput >= 5)
+        {
+            unsigned int nAddress = (g_bufferInput[2] - 48) * 100 + (g_bufferInput[3] - 48) * 10 + g_bufferInput[4] - 48;
+            if(nAddress < 1 || nAddress > MODBUS_MAX_ADDRESS)
+                return;
+            Serial.print("Modbus address=");
+            Serial.println(nAddress);
+            Serial.flush(); //Complete text before port switches to Modbus
+            SetModbusAddress(nAddress);
+        }
+        break;
+    case 'V':
+        //Verbosity
+        //V l mm - Set log level l (0=none, 1=error, 2=warning, 3=info, 4=debug) and category mask mm (hex)
+        if(g_nCursorInput >= 6)
+        {
+            byte nLevel = g_bufferInput[2] - 48;
+            if(nLevel > LOG_DEBUG)
+                return;
+            g_nLogLevel = nLevel;
+            g_nLogMask = (CharToHex(g_bufferInput[4]) << 4) + CharToHex(g_bufferInput[5]);
+            SaveSetting(EEPROM_SETTING_LOG_LEVEL, g_nLogLevel);
+            SaveSetting(EEPROM_SETTING_LOG_MASK, g_nLogMask);
+        }
+        Serial.print("Log level=");
+        Serial.print(g_nLogLevel);
+        Serial.print(" (compiled ");
+        Serial.print(LOG_LEVEL);
+        Serial.print(") mask=");
+        Serial.println(g_nLogMask, HEX);
+        break;
+#if FEATURE_BENCHMARK
+    case 'B':
+        //Benchmark
+        //B nn - Time each bus, EEPROM, RTC and LCD primitive nn times (default 10)
+        if(g_nCursorInput >= 4)
+            Benchmark((g_bufferInput[2] - 48) * 10 + g_bufferInput[3] - 48);
+        else
+            Benchmark(10);
+        break;
+#endif // FEATURE_BENCHMARK
+    case 'O':
+        //Optimise events
+        ReportOptimiseEvents(OptimiseEvents());
+        ProcessEvents();
+        break;
+    case 'H':
+        //Configuration hashes
+        {
+            //H S=ssss Z=zzzz P=pppp E=eeee eeee eeee ... (event section then each block of EVENT_BLOCK_SIZE events)
+            Scratch<84> scratchLine;
+            if(!scratchLine.Valid())
+                return;
+            char* sLine = scratchLine.Chars();
+            char* pLine = FormatString(sLine, "H S=");
+            pLine = FormatHex(pLine, g_nHashSensors >> 8);
+            pLine = FormatHex(pLine, g_nHashSensors & 0xFF);
+            pLine = FormatString(pLine, " Z=");
+            pLine = FormatHex(pLine, g_nHashZones >> 8);
+            pLine = FormatHex(pLine, g_nHashZones & 0xFF);
+            pLine = FormatString(pLine, " P=");
+            pLine = FormatHex(pLine, g_nHashSettings >> 8);
+            pLine = FormatHex(pLine, g_nHashSettings & 0xFF);
+            pLine = FormatString(pLine, " E=");
+            unsigned int nHash = GetEventHash();
+            pLine = FormatHex(pLine, nHash >> 8);
+            pLine = FormatHex(pLine, nHash & 0xFF);
+            for(byte nBlock = 0; nBlock < MAX_EVENTS / EVENT_BLOCK_SIZE; ++nBlock)
+            {
+                *pLine++ = ' ';
+                pLine = FormatHex(pLine, g_nHashEvents[nBlock] >> 8);
+                pLine = FormatHex(pLine, g_nHashEvents[nBlock] & 0xFF);
+            }
+            Serial.println(sLine);
+        }
+        break;
+    case 'W':
+        //Weather compensation
+        /*
+            "W" List outdoor sensor and compensation curves
+            "WO s" Designate sensor s as outdoor sensor (- for none)
+            "WC z p +tt +oo" Set breakpoint p (0-3) of zone z curve to outdoor temperature +/-tt C, set-point offset +/-oo C/10
+            "WC z D" Load default curve to zone z
+            "WC z -" Clear curve of zone z
+        */
+        if(g_nCursorInput >= 4 && g_bufferInput[1] == 'O')
+        {
+            byte nSensor = g_bufferInput[3] - 48;
+            if(g_bufferInput[3] == '-')
+                nSensor = OUTDOOR_NONE;
+            else if(nSensor >= MAX_SENSORS)
+                return;
+            SetOutdoorSensor(nSensor);
+        }
+        else if(g_nCursorInput >= 6 && g_bufferInput[1] == 'C')
+        {
+            byte nZone = g_bufferInput[3] - 48;
+            if(nZone > 9)
+                return;
+            if(g_bufferInput[5] == 'D' || g_bufferInput[5] == '-')
+            {
+                for(byte nPoint = 0; nPoint < CURVE_POINTS; ++nPoint)
+                {
+                    if(g_bufferInput[5] == 'D')
+                        SaveCurvePoint(nZone, nPoint, pgm_read_byte(&CURVE_DEFAULT[nPoint * 2]), pgm_read_byte(&CURVE_DEFAULT[nPoint * 2 + 1]));
+                    else
+                        SaveCurvePoint(nZone, nPoint, -1, -1); //Erased EEPROM is not a valid curve
+                }
+            }
+            else if(g_nCursorInput >= 14)
+            {
+                byte nPoint = g_bufferInput[5] - 48;
+                if(nPoint >= CURVE_POINTS)
+                    return;
+                if((g_bufferInput[7] != '+' && g_bufferInput[7] != '-') || (g_bufferInput[11] != '+' && g_bufferInput[11] != '-'))
+                    return;
+                static const byte DIGITS[] = {8, 9, 12, 13}; //Offsets of outdoor and offset digits
+                for(byte i = 0; i < sizeof(DIGITS); ++i)
+                    if(g_bufferInput[DIGITS[i]] < '0' || g_bufferInput[DIGITS[i]] > '9')
+                        return;
+                int nOutdoor = (g_bufferInput[8] - 48) * 10 + g_bufferInput[9] - 48;
+                if(g_bufferInput[7] == '-')
+                    nOutdoor = -nOutdoor;
+                int nOffset = (g_bufferInput[12] - 48) * 10 + g_bufferInput[13] - 48;
+                if(g_bufferInput[11] == '-')
+                    nOffset = -nOffset;
+                SaveCurvePoint(nZone, nPoint, nOutdoor, nOffset);
+            }
+            else
+                return;
+        }
+        ShowCompensation();
+        break;
+    case 'P':
+        //Priority
+        //P zzz hh b - Set priority zones zzz (bitwise flag in hex, 001 = zone 0), maximum hold hh minutes (00 to disable priority), b=1 to batch demand
+        if(g_nCursorInput >= 10)
+        {
+            unsigned int nPriority = (CharToHex(g_bufferInput[2]) << 8) | (CharToHex(g_bufferInput[3]) << 4) | CharToHex(g_bufferInput[4]);
+            byte nMaxHold = (g_bufferInput[6] - 48) * 10 + g_bufferInput[7] - 48;
+            if(nPriority > 0x3FF || nMaxHold > 99)
+                return;
+            SetPriority(nPriority, nMaxHold, g_bufferInput[9] != '0');
+        }
+        {
+            Scratch<72> scratchLine;
+            if(!scratchLine.Valid())
+                return;
+            char* sLine = scratchLine.Chars();
+            char* pLine = FormatString(sLine, "Priority=");
+            pLine = FormatHex(pLine, g_scheduler.nPriority >> 8);
+            pLine = FormatHex(pLine, g_scheduler.nPriority & 0xFF);
+            pLine = FormatString(pLine, " Hold=");
+            pLine = FormatUnsigned(pLine, g_scheduler.nHold);
+            pLine = FormatString(pLine, "/");
+            pLine = FormatUnsigned(pLine, g_scheduler.nMaxHold);
+            pLine = FormatString(pLine, g_scheduler.bBatch ? " Batch" : " No batch");
+            pLine = FormatString(pLine, " Relays=");
+            pLine = FormatUnsigned(pLine, g_scheduler.nTransitions);
+            pLine = FormatString(pLine, " Starts=");
+            pLine = FormatUnsigned(pLine, g_scheduler.nStarts);
+            pLine = FormatString(pLine, " Batched=");
+            FormatUnsigned(pLine, g_scheduler.nBatched);
+            Serial.println(sLine);
+        }
+        break;
+    case 'A':
+        //Adaptive hysteresis
+        //A rr mm xx - Tune each zone's hysteresis toward rr cycles per hour (00 to disable) between mm and xx (C/10)
+        if(g_nCursorInput >= 10)
+        {
+            byte nRate = (g_bufferInput[2] - 48) * 10 + g_bufferInput[3] - 48;
+            byte nMin = (g_bufferInput[5] - 48) * 10 + g_bufferInput[6] - 48;
+            byte nMax = (g_bufferInput[8] - 48) * 10 + g_bufferInput[9] - 48;
+            if(nRate > TUNE_MAX_RATE || nMin > nMax)
+                return;
+            SetTuning(nRate, nMin, nMax);
+        }
+        ShowTuning();
+        break;
+    case 'R':
+        //Thermal model
+        //R - Show each zone's learned coefficients and predictions
+        //R z - - Forget learned model of zone z
+        if(g_nCursorInput >= 5 && g_bufferInput[4] == '-')
+        {
+            byte nZone = g_bufferInput[2] - 48;
+            if(nZone > 9)
+                return;
+            memset(&g_models[nZone], 0, sizeof(model));
+            for(byte i = 0; i < EEPROM_MODEL_SIZE; ++i)
+                EEPROM.write(nZone * EEPROM_MODEL_SIZE + EEPROM_MODEL_START + i, 0xFF);
+        }
+        ShowModels();
+        break;
+#if FEATURE_JOURNAL
+    case 'J':
+        //External EEPROM journal
+        //J - Show status, J nn - Also list newest nn pages (01-99), J+ - Write collected records now
+        if(g_nCursorInput >= 2 && g_bufferInput[1] == '+')
+            JournalFlush();
+        ShowJournal((g_nCursorInput >= 4) ? (g_bufferInput[2] - 48) * 10 + g_bufferInput[3] - 48 : 0);
+        break;
+#endif // FEATURE_JOURNAL
+    case 'U':
+        //Memory usage
+        ScratchShow();
+        break;
+#if FEATURE_DIAG
+    case 'I':
+        //Interrupt latency and millis() drift
+        //I - Show, I- - Show then clear
+        DiagShow();
+        if(g_nCursorInput >= 2 && g_bufferInput[1] == '-')
+            DiagReset();
+        break;
+#endif // FEATURE_DIAG
+#if FEATURE_SCAN
     case 's':
         //Scan
         Scan();
         break;
+#endif // FEATURE_SCAN
+#if FEATURE_DEBUG_DUMP
     case 'd':
         //debug
         for(unsigned int i = 0; i <= 100; i++)
@@ -519,16 +1003,18 @@ void ParseSerial()
             Serial.println();
         }
         break;
+#endif // FEATURE_DEBUG_DUMP
     case 10:
     case 13:
         //ignore extra line endings
         break;
     default:
+#if FEATURE_SERIAL_HELP
         //Show help
-        //!@todo Remove serial help if memory becomes scarce
         Serial.println(F("E\t\t\tList Events"));
         Serial.println(F("E- ee\t\t\tDelete event ee"));
-        Serial.println(F("E+ dd hh:mm z +vvv\tAdd event dd=bitwise DoW (00 to delete event), hh:mm-time, z=zone, +/-v=temperature (x10)"));
+        Serial.println(F("E+ dd hh:mm z +vvv\tAdd event dd=bitwise DoW (01=Sunday, 40=Saturday), hh:mm-time, z=zone, +/-v=temperature (x10)"));
+        Serial.println(F("O\t\t\tOptimise events (merge days, remove shadowed events)"));
         Serial.println(F("S uuuuuuuuuuuuuuuu z\tAdd / modify sensor u=UID, z=zone"));
         Serial.println(F("S\t\t\tList Sensors"));
         Serial.println(F("T hh:mm:ss a dd/mm/yy\tSet time and date a=DoW, Sunday = 1"));
@@ -537,8 +1023,42 @@ void ParseSerial()
         Serial.println(F("CS\t\t\tClear all sensors"));
         Serial.println(F("Z z aa b\t\tConfigure zone z=zone, a=hysteresis (C/10), b=1 for space heating"));
         Serial.println(F("Z\t\t\tList zones"));
+        Serial.println(F("F n\t\t\tSet reading filter n=moving average weight 1/2^n (0-4, 0 for median only)"));
+        Serial.println(F("F\t\t\tShow reading filter"));
+        Serial.println(F("WO s\t\t\tSet outdoor sensor s (- for none)"));
+        Serial.println(F("WC z p +tt +oo\t\tSet compensation curve of zone z breakpoint p (0-3) tt=outdoor C, oo=set-point offset (C/10)"));
+        Serial.println(F("WC z D\t\t\tSet default compensation curve of zone z (D) or clear (-)"));
+        Serial.println(F("W\t\t\tShow outdoor compensation"));
+        Serial.println(F("P zzz hh b\t\tSet priority zones zzz=bitwise flag (hex, 001=zone 0), hh=maximum hold minutes (00 to disable), b=1 to batch demand"));
+        Serial.println(F("P\t\t\tShow demand scheduling, relay transitions, boiler starts and batched calls"));
+        Serial.println(F("A rr mm xx\t\tTune zone hysteresis toward rr=cycles per hour (00 to disable) between mm and xx (C/10)"));
+        Serial.println(F("A\t\t\tShow hysteresis tuning, cycle period and overshoot of each zone"));
+        Serial.println(F("R\t\t\tShow thermal model of each zone: coefficients, updates, predicted 10 minute change and minutes to set-point"));
+        Serial.println(F("R z -\t\t\tForget thermal model of zone z"));
+        Serial.println(F("H\t\t\tShow configuration hashes"));
+        Serial.println(F("V l mm\t\t\tSet log l=level (0-4), mm=category mask (hex) 01=sensors 02=schedule 04=control 08=UI 10=system"));
+        Serial.println(F("V\t\t\tShow log level"));
+#if FEATURE_BENCHMARK
+        Serial.println(F("B nn\t\t\tBenchmark 1-Wire, EEPROM, RTC & LCD nn times (01-99). Writes EEPROM slot 1023 nn times"));
+#endif // FEATURE_BENCHMARK
+        Serial.println(F("M aaa\t\t\tSwitch serial port to Modbus RTU a=slave address (001-247)"));
+        Serial.println(F("U\t\t\tShow scratch buffer peak use and free SRAM"));
+#if FEATURE_JOURNAL
+        Serial.println(F("J nn\t\t\tShow external EEPROM journal and list newest nn pages (01-99)"));
+        Serial.println(F("J+\t\t\tWrite collected journal records now"));
+#endif // FEATURE_JOURNAL
+#if FEATURE_DIAG
+        Serial.println(F("I\t\t\tShow time, interrupt blocked time and longest interrupt latency of each loop phase and millis drift against RTC"));
+        Serial.println(F("I-\t\t\tShow then clear timing diagnostics"));
+#endif // FEATURE_DIAG
+#if FEATURE_SCAN
         Serial.println(F("s\t\t\tScan for sensors"));
+#endif // FEATURE_SCAN
+#if FEATURE_DEBUG_DUMP
         Serial.println(F("d\t\t\tDebug output"));
+#endif // FEATURE_DEBUG_DUMP
+#endif // FEATURE_SERIAL_HELP
+        break;
     }
 }
 
@@ -547,23 +1067,26 @@ void ParseSerial()
 */
 void SaveEvent(unsigned int nEvent)
 {
-    EEPROM.write(nEvent * EEPROM_EVENT_SIZE + EEPROM_EVENT_START, g_events[nEvent].nDays);
-    EEPROM.write(nEvent * EEPROM_EVENT_SIZE + EEPROM_EVENT_START + 1, (g_events[nEvent].nTime & 0xFF00) >> 8);
-    EEPROM.write(nEvent * EEPROM_EVENT_SIZE + EEPROM_EVENT_START + 2, g_events[nEvent].nTime & 0xFF);
-    EEPROM.write(nEvent * EEPROM_EVENT_SIZE + EEPROM_EVENT_START + 3, g_events[nEvent].nZone);
-    EEPROM.write(nEvent * EEPROM_EVENT_SIZE + EEPROM_EVENT_START + 4, (g_events[nEvent].nValue & 0xFF00) >> 8);
-    EEPROM.write(nEvent * EEPROM_EVENT_SIZE + EEPROM_EVENT_START + 5, g_events[nEvent].nValue & 0xFF);
+    unsigned int nCrc = RecordCrc(nEvent * EEPROM_EVENT_SIZE + EEPROM_EVENT_START, EEPROM_EVENT_SIZE, nEvent, true);
+    SaveRecord(nEvent * EEPROM_EVENT_SIZE + EEPROM_EVENT_START, EEPROM_EVENT_SIZE, EVENT_FIELDS, EVENT_FIELD_QUANT, &g_events[nEvent]);
+    g_nHashEvents[nEvent / EVENT_BLOCK_SIZE] ^= nCrc ^ RecordCrc(nEvent * EEPROM_EVENT_SIZE + EEPROM_EVENT_START, EEPROM_EVENT_SIZE, nEvent, true);
 }
 
 /**  @brief  Saves a zone to EEPROM
 *    @param  nZone Zone index
+*    @param  bHyst True to save hysteresis as configured value and restart its tuning. False to leave configured hysteresis
 */
-void SaveZone(unsigned int nZone)
+void SaveZone(unsigned int nZone, bool bHyst)
 {
-    EEPROM.write(nZone * EEPROM_ZONE_SIZE + EEPROM_ZONE_START, g_zones[nZone].nHyst);
-    EEPROM.write(nZone * EEPROM_ZONE_SIZE + EEPROM_ZONE_START + 1, g_zones[nZone].bSpace?1:0);
-    for(unsigned int i = 0; i < 10; ++i)
-        EEPROM.write(nZone * EEPROM_ZONE_SIZE + EEPROM_ZONE_START + 2 + i, g_zones[nZone].sName[i]);
+    unsigned int nCrc = RecordCrc(nZone * EEPROM_ZONE_SIZE + EEPROM_ZONE_START, EEPROM_ZONE_RECORD, nZone, false);
+    if(bHyst)
+    {
+        memset(&g_tuners[nZone], 0, sizeof(tuner));
+        if(EEPROM.read(nZone + EEPROM_TUNED_START) != 0xFF)
+            EEPROM.write(nZone + EEPROM_TUNED_START, 0xFF);
+    }
+    SaveRecord(nZone * EEPROM_ZONE_SIZE + EEPROM_ZONE_START, EEPROM_ZONE_CURVE, ZONE_FIELDS, ZONE_FIELD_QUANT, &g_zones[nZone], bHyst ? 0xFFFF : ~ZONE_FIELD_HYST);
+    g_nHashZones ^= nCrc ^ RecordCrc(nZone * EEPROM_ZONE_SIZE + EEPROM_ZONE_START, EEPROM_ZONE_RECORD, nZone, false);
 }
 
 /** @brief  Saves a sensor configuration to EEPROM
@@ -571,15 +1094,58 @@ void SaveZone(unsigned int nZone)
 */
 void SaveSensor(unsigned int nSensor)
 {
-    for(unsigned int i = 0; i < 8; ++i)
-        EEPROM.write(nSensor * EEPROM_SENSOR_SIZE + EEPROM_SENSOR_START + i, g_sensors[nSensor].address[i]);
-    EEPROM.write(nSensor * EEPROM_SENSOR_SIZE + EEPROM_SENSOR_START + 8, g_sensors[nSensor].nZone);
+    unsigned int nCrc = RecordCrc(nSensor * EEPROM_SENSOR_SIZE + EEPROM_SENSOR_START, EEPROM_SENSOR_RECORD, nSensor, true);
+    SaveRecord(nSensor * EEPROM_SENSOR_SIZE + EEPROM_SENSOR_START, EEPROM_SENSOR_RECORD, SENSOR_FIELDS, SENSOR_FIELD_QUANT, &g_sensors[nSensor]);
+    g_nHashSensors ^= nCrc ^ RecordCrc(nSensor * EEPROM_SENSOR_SIZE + EEPROM_SENSOR_START, EEPROM_SENSOR_RECORD, nSensor, true);
+}
+
+/** @brief  Saves a controller setting to EEPROM
+*   @param  nOffset Offset of setting within settings section
+*   @param  nValue Value to save
+*/
+void SaveSetting(unsigned int nOffset, byte nValue)
+{
+    unsigned int nCrc = RecordCrc(EEPROM_SETTINGS_START, EEPROM_SETTINGS_SIZE, 0, false);
+    EEPROM.write(EEPROM_SETTINGS_START + nOffset, nValue);
+    g_nHashSettings ^= nCrc ^ RecordCrc(EEPROM_SETTINGS_START, EEPROM_SETTINGS_SIZE, 0, false);
+}
+
+/** @brief  Calculates the configuration hash contribution of an EEPROM record
+*   @param  nAddress EEPROM address of record
+*   @param  nSize Quantity of bytes in record
+*   @param  nIndex Index of record within its section
+*   @param  bSkipEmpty True if record with zero first byte is unconfigured and contributes zero
+*   @return <i>unsigned int</i> CRC-16/MODBUS of index followed by record bytes
+*   @note   Section hash is XOR of its record CRCs so a host can calculate it from desired configuration and a save
+*           updates it by removing the old record CRC and adding the new one
+*/
+unsigned int RecordCrc(unsigned int nAddress, byte nSize, byte nIndex, bool bSkipEmpty)
+{
+    if(bSkipEmpty && EEPROM.read(nAddress) == 0)
+        return 0;
+    unsigned int nCrc = ModbusCrcByte(0xFFFF, nIndex);
+    for(byte i = 0; i < nSize; ++i)
+        nCrc = ModbusCrcByte(nCrc, EEPROM.read(nAddress + i));
+    return nCrc;
+}
+
+/** @brief  Gets configuration hash of event section
+*   @return <i>unsigned int</i> XOR of event block hashes
+*/
+unsigned int GetEventHash()
+{
+    unsigned int nHash = 0;
+    for(byte nBlock = 0; nBlock < MAX_EVENTS / EVENT_BLOCK_SIZE; ++nBlock)
+        nHash ^= g_nHashEvents[nBlock];
+    return nHash;
 }
 
 /**  Add a sensor and write configuration to EEPROM
 */
 void AddSensor(byte* pAddress, byte nZone)
 {
+    if(nZone > 9)
+        return; //Zone index would be outside g_zones
     bool bDuplicate = false;
     unsigned int nSensor;
     for(nSensor = 0; nSensor < g_nSensorQuant; nSensor++)
@@ -610,168 +1176,242 @@ void AddSensor(byte* pAddress, byte nZone)
         for(unsigned int i = 0; i < 8; ++i)
         {
             g_sensors[g_nSensorQuant].address[i] = *(pAddress + i);
-            EEPROM.write(g_nSensorQuant * 10 + i, g_sensors[g_nSensorQuant].address[i]);
             Serial.print(g_sensors[g_nSensorQuant].address[i], HEX);
         }
         Serial.println("]");
+        g_sensors[g_nSensorQuant].nSamples = 0; //Restart reading filter
+        g_sensors[g_nSensorQuant].nCrcRetries = 0;
+        g_sensors[g_nSensorQuant].nCrcErrors = 0;
+        g_sensors[g_nSensorQuant].nPowerOn = 0;
         ++g_nSensorQuant;
     }
     else
         Serial.println("Updating existing sensor");
     g_sensors[nSensor].nZone = nZone;
-    EEPROM.write(nSensor * 10 + 8, nZone);
+    SaveSensor(nSensor);
     GetTemperature(nSensor);
 }
 
+#if FEATURE_SCAN
 /** @brief  Scans sensor network
 *   @note   Prints list of sensor UID and current values to serial port
 */
 void Scan()
 {
-    byte pAddress[8];
+    Scratch<8> scratchAddress;
+    if(!scratchAddress.Valid())
+        return;
+    byte* pAddress = scratchAddress.Bytes();
     while(ds.search(pAddress))
     {
+        Scratch<52> scratchLine;
+        if(!scratchLine.Valid())
+            break;
+        char* sLine = scratchLine.Chars();
+        char* pLine = sLine;
         for(unsigned int i = 0; i < 8; i++)
-        {
-            if(pAddress[i] < 0x10)
-                Serial.print("0");
-            Serial.print(pAddress[i], HEX);
-        }
-        Serial.print(" Value=");
-        float fTemp = GetTemperature(pAddress);
-        if(fTemp == -2000)
-            Serial.println("Error reading temperature");
+            pLine = FormatHex(pLine, pAddress[i]);
+        pLine = FormatString(pLine, " Value=");
+        int nValue = GetTemperature(pAddress);
+        if(nValue == -2000)
+            FormatString(pLine, "Error reading temperature");
         else
         {
-            Serial.print(fTemp / 100);
-            Serial.println("C");
+            pLine = FormatFixed(pLine, nValue, 2);
+            FormatString(pLine, "C");
         }
+        Serial.println(sLine);
     }
 }
+#endif // FEATURE_SCAN
 
 /** @brief  Gets the temperature value from a sensor
 *   @param  pAddress Pointer to the UID of the sensor
+*   @param  nSensor Index of configured sensor to record bus statistics against (0xFF for none)
+*   @param  bConvert True to start a conversion and wait for it. False to read result of bus-wide conversion.
 *   @return <i>int</i> Temperature in 1/100ths of degrees
 *   @note   Returns -2000 on error
+*   @note   Scratchpad is re-read up to SCRATCHPAD_RETRIES times on CRC failure. Power-on value triggers one new conversion.
 */
-int GetTemperature(byte* pAddress)
+int GetTemperature(byte* pAddress, byte nSensor, bool bConvert)
+{
+    sensor* pSensor = (nSensor < MAX_SENSORS) ? &g_sensors[nSensor] : NULL;
+    bool bReconverted = false;
+    Scratch<9> scratchData;
+    if(!scratchData.Valid())
+        return -2000;
+    byte* data = scratchData.Bytes();
+    if(bConvert)
+        ConvertTemperature(pAddress);
+    for(byte nRetry = 0; nRetry <= SCRATCHPAD_RETRIES; ++nRetry)
+    {
+        if(!ReadScratchpad(pAddress, data))
+        {
+            if(pSensor && nRetry < SCRATCHPAD_RETRIES)
+                ++pSensor->nCrcRetries;
+            continue;
+        }
+        int nValue = data[0] | (data[1] << 8); //1/16ths of degrees, 2's complement
+        if(nValue == DS18B20_POWERON && !bReconverted)
+        {
+            //Sensor may have reset since conversion started so convert again
+            bReconverted = true;
+            if(pSensor)
+                ++pSensor->nPowerOn;
+            ConvertTemperature(pAddress);
+            continue;
+        }
+        return nValue * 6 + nValue / 4;
+    }
+    if(pSensor)
+        ++pSensor->nCrcErrors;
+    return -2000;
+}
+
+/** @brief  Starts a temperature conversion and waits for it to complete
+*   @param  pAddress Pointer to the UID of the sensor
+*/
+void ConvertTemperature(byte* pAddress)
 {
     ds.reset();
     ds.select(pAddress);
     ds.write(0x44); //Start conversion
     delay(1000); //Wait for read to complete
+}
 
+/** @brief  Starts temperature conversion of every sensor on the bus without waiting
+*   @note   Uses skip ROM so one command converts all sensors. Results are read with GetTemperature(nSensor, false).
+*/
+void StartConversion()
+{
     ds.reset();
+    ds.skip();
+    ds.write(0x44); //Start conversion
+    g_lConvertStart = millis();
+    g_bConverting = true;
+}
+
+/** @brief  Waits for remainder of bus-wide conversion
+*   @note   Returns immediately when conversion was started at least DS18B20_CONVERT_TIME ago
+*/
+void WaitConversion()
+{
+    unsigned long lElapsed = millis() - g_lConvertStart;
+    if(lElapsed < DS18B20_CONVERT_TIME)
+        delay(DS18B20_CONVERT_TIME - lElapsed);
+}
+
+/** @brief  Reads a sensor's scratchpad
+*   @param  pAddress Pointer to the UID of the sensor
+*   @param  pData Pointer to 9 byte buffer to populate with scratchpad
+*   @return <i>bool</i> True if sensor present and CRC valid
+*/
+bool ReadScratchpad(byte* pAddress, byte* pData)
+{
+    if(!ds.reset())
+        return false; //No presence pulse
     ds.select(pAddress);
     ds.write(0xBE);
-    byte data[9];
-    for(int i = 0; i < 9; i++)
-        data[i] = ds.read();
-
-    if(OneWire::crc8(data, 8) == data[8])
-    {
-        int nValue = (data[0] + (data[1] << 8));
-        if(nValue & 0x8000) // negative
-            nValue = (nValue ^ 0xffff) + 1; // 2's comp
-        return nValue * 6.25;
-    }
-    return -2000;
+    for(byte i = 0; i < 9; i++)
+        pData[i] = ds.read();
+    return OneWire::crc8(pData, 8) == pData[8];
 }
 
 /**  @brief  Updates the temperature reading from a sensor
 *    @param  nSensor Sensor index
+*    @param  bConvert True to start a conversion and wait for it. False to read result of bus-wide conversion.
 *    @return <i>bool</i> True on success
 */
-bool GetTemperature(unsigned int nSensor)
+bool GetTemperature(unsigned int nSensor, bool bConvert)
 {
     if(nSensor >= MAX_SENSORS)
         return false;
-    int nValue = GetTemperature(g_sensors[nSensor].address);
+    int nValue = GetTemperature(g_sensors[nSensor].address, nSensor, bConvert);
     if(nValue == -2000)
+    {
+        LOG_IF(LOG_WARN, LOG_ACQUISITION)
+        {
+            Serial.print(F("Sensor "));
+            Serial.print(nSensor);
+            Serial.println(F(" read failed"));
+        }
         return false;
-    g_sensors[nSensor].nValue = nValue;
+    }
+    FilterReading(&g_sensors[nSensor], nValue, g_nFilterShift);
     return true;
 }
 
 /** @brief  Gets the date and time from the DS1307 RTC
-*   @param  bShow Print result to serial if true
+*   @param  bShow Show result on LCD if true and LCD is showing clock
+*   @param  bPrint Print result to serial if true
 *   @return <i>byte<i> Number of seconds since minute boundary
 *   @note   Updates g_nNow with number of minutes since 00:00 Sunday
+*   @note   Waits for I2C transaction which is aborted if RTC does not respond within TWI timeout
 */
-byte getTime(bool bShow)
+byte getTime(bool bShow, bool bPrint)
 {
 #ifdef _DEBUG_
     return 0; //Allow debugging without RTC connected
 #endif // _DEBUG_
-    // Reset the register pointer
-    Wire.beginTransmission(DS1307_I2C_ADDRESS);
-    Wire.write(0);
-    Wire.endTransmission();
+    TwiWait(); //Allow any background transaction to complete
+    if(!requestTime() || !TwiWait())
+        return 0; //RTC not responding - keep previous time
+    return decodeTime(bShow, bPrint);
+}
 
-    Wire.requestFrom(DS1307_I2C_ADDRESS, 7); //Get 7 bytes of data from RTC
+/** @brief  Starts background read of the date and time from the DS1307 RTC
+*   @return <i>bool</i> True if read started
+*   @note   Poll TwiStatus() for completion then call decodeTime()
+*/
+bool requestTime()
+{
+    static const byte nRegister = 0;
+    return TwiStart(DS1307_I2C_ADDRESS, &nRegister, 1, g_bufferRtc, DS1307_TIME_REGISTERS);
+}
 
+/** @brief  Decodes date and time read from the DS1307 RTC
+*   @param  bShow Show result on LCD if true and LCD is showing clock
+*   @param  bPrint Print result to serial if true
+*   @return <i>byte<i> Number of seconds since minute boundary
+*   @note   Updates g_nNow with number of minutes since 00:00 Sunday
+*/
+byte decodeTime(bool bShow, bool bPrint)
+{
     // A few of these need masks because certain bits are control bits
-    byte nSecond     = bcdToDec(Wire.read() & 0x7f);
-    byte nMinute     = bcdToDec(Wire.read());
-    byte nHour       = bcdToDec(Wire.read() & 0x3f);  // Need to change this if 12 hour am/pm
-    g_tsNow.nDay     = bcdToDec(Wire.read());
-    byte nDay        = bcdToDec(Wire.read());
-    byte nMonth      = bcdToDec(Wire.read());
-    byte nYear       = bcdToDec(Wire.read());
+    byte nSecond     = bcdToDec(g_bufferRtc[0] & 0x7f);
+    byte nMinute     = bcdToDec(g_bufferRtc[1]);
+    byte nHour       = bcdToDec(g_bufferRtc[2] & 0x3f);  // Need to change this if 12 hour am/pm
+    byte nDow        = bcdToDec(g_bufferRtc[3] & 0x07); // 1 = Sunday
+    g_tsNow.nDay     = (nDow > 0) ? 1 << (nDow - 1) : 0;
+    byte nDay        = bcdToDec(g_bufferRtc[4]);
+    byte nMonth      = bcdToDec(g_bufferRtc[5]);
+    byte nYear       = bcdToDec(g_bufferRtc[6]);
     g_tsNow.nTime    = nMinute + nHour * 60;
 
-    if(bShow && g_nSelectedZone == 0xFF)
+    bShow &= UiShowingClock(); //LCD may be showing a zone
+    if(bShow || bPrint)
     {
         //!@todo Reduce vebosity of date if memory becomes sparse
-        g_lcd.clear();
-        if (nHour < 10)
-        {
-            g_lcd.print("0");
-            Serial.print("0");
-        }
-        g_lcd.print(nHour);
-        Serial.print(nHour, DEC);
-        g_lcd.print(":");
-        Serial.print(":");
-        if (nMinute < 10)
-        {
-            g_lcd.print("0");
-            Serial.print("0");
-        }
-        g_lcd.print(nMinute);
-        Serial.print(nMinute, DEC);
-        Serial.print(":");
-        if (nSecond < 10)
-        {
-            Serial.print("0");
-        }
-        Serial.print(nSecond, DEC);
-        g_lcd.setCursor(0,1);
-        Serial.print("  ");
-        g_lcd.print(DOW[g_tsNow.nDay]);
-        Serial.print(DOW[g_tsNow.nDay]);
-        g_lcd.print(" ");
-        Serial.print(" ");
-        g_lcd.print(nDay);
-        Serial.print(nDay, DEC);
-        g_lcd.print("/");
-        Serial.print("/");
-        if(nMonth < 10)
-        {
-            g_lcd.print("0");
-            Serial.print("0");
-        }
-        g_lcd.print(nMonth);
-        Serial.print(nMonth, DEC);
-        g_lcd.print("/");
-        Serial.print("/");
-        if (nYear < 10)
-        {
-            g_lcd.print("0");
-            Serial.print("0");
-        }
-        g_lcd.print(nYear);
-        Serial.println(nYear, DEC);
+        //Format "hh:mm:ss  Dow d/mm/yy" once. LCD shows "hh:mm" on first line and date on second line.
+        char sTime[24];
+        char* pText = FormatUnsigned(sTime, nHour, 2, '0');
+        *pText++ = ':';
+        pText = FormatUnsigned(pText, nMinute, 2, '0');
+        *pText++ = ':';
+        pText = FormatUnsigned(pText, nSecond, 2, '0');
+        pText = FormatString(pText, "  ");
+        char* pDate = pText;
+        pText = FormatString(pText, DOW[nDow]);
+        *pText++ = ' ';
+        pText = FormatUnsigned(pText, nDay);
+        *pText++ = '/';
+        pText = FormatUnsigned(pText, nMonth, 2, '0');
+        *pText++ = '/';
+        FormatUnsigned(pText, nYear, 2, '0');
+        if(bShow)
+            UiShowClock(sTime, pDate);
+        if(bPrint)
+            Serial.println(sTime);
     }
     return nSecond;
 }
@@ -783,12 +1423,14 @@ byte getTime(bool bShow)
 */
 void setTime(unsigned int nHour, unsigned int nMinute, unsigned int nSecond)
 {
-    Wire.beginTransmission(DS1307_I2C_ADDRESS);
-    Wire.write(0); //Set cursor to seconds register
-    Wire.write(decToBcd(nSecond) & 0x7f); // Reset bit 7 starts the clock
-    Wire.write(decToBcd(nMinute));
-    Wire.write(decToBcd(nHour)); // If you want 12 hour am/pm you need to set
-    Wire.endTransmission();
+    byte data[4];
+    data[0] = 0; //Set cursor to seconds register
+    data[1] = decToBcd(nSecond) & 0x7f; // Reset bit 7 starts the clock
+    data[2] = decToBcd(nMinute);
+    data[3] = decToBcd(nHour); // If you want 12 hour am/pm you need to set
+    TwiWait();
+    if(TwiStart(DS1307_I2C_ADDRESS, data, 4))
+        TwiWait();
     g_tsNow.nTime = nMinute + nHour * 60;
 }
 
@@ -800,13 +1442,15 @@ void setTime(unsigned int nHour, unsigned int nMinute, unsigned int nSecond)
 */
 void setDate(unsigned int nDow, unsigned int nDay, unsigned int nMonth, unsigned int nYear)
 {
-    Wire.beginTransmission(DS1307_I2C_ADDRESS);
-    Wire.write(3); //Set cursor to DoW register
-    Wire.write(decToBcd(nDow));
-    Wire.write(decToBcd(nDay));
-    Wire.write(decToBcd(nMonth));
-    Wire.write(decToBcd(nYear));
-    Wire.endTransmission();
+    byte data[5];
+    data[0] = 3; //Set cursor to DoW register
+    data[1] = decToBcd(nDow);
+    data[2] = decToBcd(nDay);
+    data[3] = decToBcd(nMonth);
+    data[4] = decToBcd(nYear);
+    TwiWait();
+    if(TwiStart(DS1307_I2C_ADDRESS, data, 5))
+        TwiWait();
     g_tsNow.nDay = 1 << (nDow - 1);
 }
 
@@ -843,6 +1487,7 @@ void ProcessEvents()
         {
             //Set zone temperature set-point
             g_zones[g_events[nEvent].nZone].nSetpoint = g_events[nEvent].nValue;
+            JournalAdd(JOURNAL_TRACE, JOURNAL_TRACE_EVENT, GetMinuteOfWeek(), nEvent);
         }
 
         //Find next scheduled event
@@ -860,13 +1505,22 @@ void ProcessEvents()
         if(g_tsNextEvent.nDay > 127)
             g_tsNextEvent.nDay = 1; //wrap round to Sunday if reached end of Saturday
     }
-    //!@todo remove this debug output
-    Serial.print("Next event: ");
-    Serial.print(g_tsNextEvent.nTime);
-    Serial.print(" on ");
-    Serial.println(g_tsNextEvent.nDay);
+    LOG_IF(LOG_DEBUG, LOG_SCHEDULE)
+    {
+        Serial.print(F("Next event: "));
+        Serial.print(g_tsNextEvent.nTime);
+        Serial.print(F(" on "));
+        Serial.println(g_tsNextEvent.nDay);
+    }
 }
 
+/** @brief  Adds an event to end of schedule
+*   @param  nZone Zone index
+*   @param  nDays Bitwise flag of days of week. LSB = Sunday
+*   @param  nTime Minutes since 00:00
+*   @param  nSetpoint Temperature set-point (C/10)
+*   @param  bSave True to save to EEPROM
+*/
 void AddEvent(byte nZone, byte nDays, unsigned int nTime, int nSetpoint, bool bSave)
 {
     if(g_nEventQuant >= MAX_EVENTS)
@@ -880,13 +1534,16 @@ void AddEvent(byte nZone, byte nDays, unsigned int nTime, int nSetpoint, bool bS
     g_nEventQuant++;
 }
 
+/** @brief  Deletes an event, shifting later events down
+*   @param  nEvent Event index
+*/
 void DeleteEvent(byte nEvent)
 {
     if(nEvent >= g_nEventQuant)
         return;
     //Deleting event so shift all others
     byte nEventQuant;
-    for(nEventQuant = nEvent; nEventQuant < g_nEventQuant; nEventQuant++)
+    for(nEventQuant = nEvent; nEventQuant + 1 < g_nEventQuant; nEventQuant++)
     {
         g_events[nEventQuant].nDays = g_events[nEventQuant + 1].nDays;
         g_events[nEventQuant].nTime = g_events[nEventQuant + 1].nTime;
@@ -895,6 +1552,87 @@ void DeleteEvent(byte nEvent)
         SaveEvent(nEventQuant);
     }
     --g_nEventQuant;
+    ClearEvent(g_nEventQuant);
+}
+
+/** @brief  Marks an event slot as unconfigured
+*   @param  nEvent Event index
+*   @note   Only writes day of week in EEPROM. Slots after last event must be cleared so events load contiguously.
+*/
+void ClearEvent(byte nEvent)
+{
+    unsigned int nAddress = nEvent * EEPROM_EVENT_SIZE + EEPROM_EVENT_START;
+    g_nHashEvents[nEvent / EVENT_BLOCK_SIZE] ^= RecordCrc(nAddress, EEPROM_EVENT_SIZE, nEvent, true); //Empty slot contributes zero
+    EEPROM.write(nAddress, 0);
+    g_events[nEvent].nDays = 0;
+}
+
+/** @brief  Merges and removes redundant events
+*   @return <i>byte</i> Quantity of events removed
+*   @note   Days of an event are removed where a later event at the same time and zone overrides it. Events that then
+*           differ only by day are merged into one. Remaining events are compacted and only changed slots are saved.
+*/
+byte OptimiseEvents()
+{
+    byte changed[(MAX_EVENTS + 7) / 8]; //Bitwise flag of events modified
+    memset(changed, 0, sizeof(changed));
+    for(byte nEvent = 0; nEvent < g_nEventQuant; ++nEvent)
+    {
+        for(byte nLater = nEvent + 1; nLater < g_nEventQuant; ++nLater)
+        {
+            if(g_events[nLater].nTime != g_events[nEvent].nTime || g_events[nLater].nZone != g_events[nEvent].nZone)
+                continue;
+            if(g_events[nEvent].nDays & g_events[nLater].nDays)
+            {
+                //Later event overrides on common days
+                g_events[nEvent].nDays &= ~g_events[nLater].nDays;
+                changed[nEvent / 8] |= 1 << (nEvent % 8);
+            }
+        }
+    }
+    //Events at same time and zone now have disjoint days so order between them no longer matters
+    for(byte nEvent = 0; nEvent < g_nEventQuant; ++nEvent)
+    {
+        if(!g_events[nEvent].nDays)
+            continue;
+        for(byte nLater = nEvent + 1; nLater < g_nEventQuant; ++nLater)
+        {
+            if(g_events[nLater].nDays && g_events[nLater].nTime == g_events[nEvent].nTime
+                && g_events[nLater].nZone == g_events[nEvent].nZone && g_events[nLater].nValue == g_events[nEvent].nValue)
+            {
+                g_events[nEvent].nDays |= g_events[nLater].nDays;
+                g_events[nLater].nDays = 0;
+                changed[nEvent / 8] |= 1 << (nEvent % 8);
+            }
+        }
+    }
+    //Compact
+    byte nQuant = 0;
+    for(byte nEvent = 0; nEvent < g_nEventQuant; ++nEvent)
+    {
+        if(!g_events[nEvent].nDays)
+            continue;
+        if(nEvent != nQuant)
+            g_events[nQuant] = g_events[nEvent];
+        if(nEvent != nQuant || changed[nEvent / 8] & (1 << (nEvent % 8)))
+            SaveEvent(nQuant);
+        ++nQuant;
+    }
+    byte nRemoved = g_nEventQuant - nQuant;
+    while(g_nEventQuant > nQuant)
+        ClearEvent(--g_nEventQuant);
+    return nRemoved;
+}
+
+/** @brief  Reports result of event optimisation to serial port
+*   @param  nRemoved Quantity of events removed
+*/
+void ReportOptimiseEvents(byte nRemoved)
+{
+    Serial.print("Optimised events: removed=");
+    Serial.print(nRemoved);
+    Serial.print(" quantity=");
+    Serial.println(g_nEventQuant);
 }
 
 byte CharToHex(char nChar)
@@ -907,114 +1645,763 @@ byte CharToHex(char nChar)
     return nValue;
 }
 
-void OnButtonUpDown(bool bUp)
+/** @brief  Sets the reading filter moving average weight
+*   @param  nShift Weight of each new reading is 1/2^nShift (0 - FILTER_MAX_SHIFT)
+*/
+void SetFilterShift(byte nShift)
+{
+    g_nFilterShift = nShift;
+    SaveSetting(EEPROM_SETTING_FILTER, nShift);
+    for(unsigned int nSensor = 0; nSensor < g_nSensorQuant; ++nSensor)
+        g_sensors[nSensor].lFilter = (long)g_sensors[nSensor].nValue << nShift; //Rescale accumulator to new weight
+}
+
+/** @brief  Sets the Modbus slave address
+*   @param  nAddress Slave address (1-247) or 0 to return serial port to text commands
+*/
+void SetModbusAddress(byte nAddress)
 {
-    if(g_bEdit)
+    g_nModbusAddress = nAddress;
+    SaveSetting(EEPROM_SETTING_MODBUS, nAddress);
+}
+
+/** @brief  Sets zone demand scheduling
+*   @param  nPriority Bitwise flag of zones served before others
+*   @param  nMaxHold Maximum minutes priority zones may hold off other zones. 0 to disable priority
+*   @param  bBatch True to let zones due to call for heat share a burn
+*/
+void SetPriority(unsigned int nPriority, byte nMaxHold, bool bBatch)
+{
+    g_scheduler.nPriority = nPriority;
+    g_scheduler.nMaxHold = nMaxHold;
+    g_scheduler.bBatch = bBatch;
+    SaveSetting(EEPROM_SETTING_BATCH, bBatch ? 1 : 0);
+    SaveSetting(EEPROM_SETTING_PRIORITY, nPriority >> 8);
+    SaveSetting(EEPROM_SETTING_PRIORITY + 1, nPriority & 0xFF);
+    SaveSetting(EEPROM_SETTING_MAX_HOLD, nMaxHold);
+}
+
+/** @brief  Sets hysteresis tuning
+*   @param  nRate Target cycles per hour (1 - TUNE_MAX_RATE). 0 to fix each zone's hysteresis at its configured value
+*   @param  nMin Minimum tuned hysteresis (C/10)
+*   @param  nMax Maximum tuned hysteresis (C/10)
+*/
+void SetTuning(byte nRate, byte nMin, byte nMax)
+{
+    if(g_nTuneRate && !nRate)
     {
-        if(g_zones[g_nSelectedZone].bSpace)
+        for(byte nZone = 0; nZone < 10; ++nZone)
+            g_zones[nZone].nHyst = EEPROM.read(nZone * EEPROM_ZONE_SIZE + EEPROM_ZONE_START);
+    }
+    g_nTuneRate = nRate;
+    g_nTuneMin = nMin;
+    g_nTuneMax = nMax;
+    for(byte nZone = 0; nZone < 10; ++nZone)
+        memset(&g_tuners[nZone], 0, sizeof(tuner));
+    SaveSetting(EEPROM_SETTING_TUNE_RATE, nRate);
+    SaveSetting(EEPROM_SETTING_TUNE_MIN, nMin);
+    SaveSetting(EEPROM_SETTING_TUNE_MAX, nMax);
+}
+
+/** @brief  Saves a zone's settled tuned hysteresis to EEPROM
+*   @param  nZone Zone index
+*   @note   Only called when tuning settles and only writes a changed value to limit EEPROM wear
+*/
+void SaveTunedHyst(byte nZone)
+{
+    if(EEPROM.read(nZone + EEPROM_TUNED_START) == g_zones[nZone].nHyst)
+        return;
+    EEPROM.write(nZone + EEPROM_TUNED_START, g_zones[nZone].nHyst);
+    LOG_IF(LOG_INFO, LOG_CONTROL)
+    {
+        Scratch<32> scratchLine;
+        if(!scratchLine.Valid())
+            return;
+        char* sLine = scratchLine.Chars();
+        strcpy_P(sLine, PSTR("Zone "));
+        char* pLine = FormatUnsigned(sLine + strlen(sLine), nZone);
+        strcpy_P(pLine, PSTR(" hysteresis settled "));
+        FormatFixed(pLine + strlen(pLine), g_zones[nZone].nHyst, 1);
+        Serial.println(sLine);
+    }
+}
+
+/** @brief  Prints hysteresis tuning and each zone's cycle measurements to serial port */
+void ShowTuning()
+{
+    Scratch<72> scratchLine;
+    if(!scratchLine.Valid())
+        return;
+    char* sLine = scratchLine.Chars();
+    char* pLine = FormatString(sLine, "Tuning ");
+    if(g_nTuneRate)
+    {
+        pLine = FormatUnsigned(pLine, g_nTuneRate);
+        pLine = FormatString(pLine, "/h");
+    }
+    else
+        pLine = FormatString(pLine, "off");
+    pLine = FormatString(pLine, " Hyst=");
+    pLine = FormatFixed(pLine, g_nTuneMin, 1);
+    pLine = FormatString(pLine, "-");
+    FormatFixed(pLine, g_nTuneMax, 1);
+    Serial.println(sLine);
+    for(byte nZone = 0; nZone < 10; ++nZone)
+    {
+        pLine = FormatUnsigned(sLine, nZone);
+        pLine = FormatString(pLine, "  Hyst=");
+        pLine = FormatFixed(pLine, g_zones[nZone].nHyst, 1);
+        pLine = FormatString(pLine, " Set=");
+        pLine = FormatFixed(pLine, EEPROM.read(nZone * EEPROM_ZONE_SIZE + EEPROM_ZONE_START), 1);
+        pLine = FormatString(pLine, " Period=");
+        pLine = FormatUnsigned(pLine, g_tuners[nZone].nPeriod);
+        pLine = FormatString(pLine, "min Overshoot=");
+        pLine = FormatFixed(pLine, g_tuners[nZone].nOvershoot, 2);
+        pLine = FormatString(pLine, " Settled=");
+        FormatUnsigned(pLine, g_tuners[nZone].nSettled);
+        Serial.println(sLine);
+    }
+}
+
+/** @brief  Designates the sensor that measures outdoor temperature
+*   @param  nSensor Sensor index or OUTDOOR_NONE to disable compensation
+*/
+void SetOutdoorSensor(byte nSensor)
+{
+    g_nOutdoorSensor = nSensor;
+    SaveSetting(EEPROM_SETTING_OUTDOOR, nSensor);
+    if(nSensor == OUTDOOR_NONE)
+    {
+        for(byte nZone = 0; nZone < 10; ++nZone)
+            g_zones[nZone].nCompensation = 0;
+    }
+    g_nOutdoor = OUTDOOR_UNKNOWN; //Recalculate on next reading
+}
+
+/** @brief  Saves a breakpoint of a zone's compensation curve to EEPROM
+*   @param  nZone Zone index
+*   @param  nPoint Breakpoint index (0 - CURVE_POINTS-1)
+*   @param  nOutdoor Outdoor temperature (C)
+*   @param  nOffset Set-point offset (C/10)
+*/
+void SaveCurvePoint(byte nZone, byte nPoint, signed char nOutdoor, signed char nOffset)
+{
+    unsigned int nAddress = nZone * EEPROM_ZONE_SIZE + EEPROM_ZONE_START;
+    unsigned int nCrc = RecordCrc(nAddress, EEPROM_ZONE_RECORD, nZone, false);
+    EEPROM.write(nAddress + EEPROM_ZONE_CURVE + nPoint * 2, nOutdoor);
+    EEPROM.write(nAddress + EEPROM_ZONE_CURVE + nPoint * 2 + 1, nOffset);
+    g_nHashZones ^= nCrc ^ RecordCrc(nAddress, EEPROM_ZONE_RECORD, nZone, false);
+    g_nOutdoor = OUTDOOR_UNKNOWN; //Recalculate on next reading
+}
+
+/** @brief  Updates each zone's set-point compensation from outdoor temperature
+*   @note   Curves are only interpolated when the outdoor reading changes (by at least 0.1C)
+*/
+void UpdateCompensation()
+{
+    int nOutdoor = g_sensors[g_nOutdoorSensor].nValue / 10;
+    if(nOutdoor == g_nOutdoor)
+        return;
+    g_nOutdoor = nOutdoor;
+    for(byte nZone = 0; nZone < 10; ++nZone)
+    {
+        signed char pCurve[CURVE_POINTS * 2];
+        for(byte i = 0; i < CURVE_POINTS * 2; ++i)
+            pCurve[i] = EEPROM.read(nZone * EEPROM_ZONE_SIZE + EEPROM_ZONE_START + EEPROM_ZONE_CURVE + i);
+        g_zones[nZone].nCompensation = InterpolateCurve(pCurve, nOutdoor);
+    }
+    LOG_IF(LOG_DEBUG, LOG_CONTROL)
+    {
+        Serial.print(F("Outdoor="));
+        Serial.println(nOutdoor);
+    }
+}
+
+/** @brief  Saves each zone's thermal model coefficients to EEPROM
+*   @note   Only writes bytes that have changed and only coefficients with MODEL_MIN_SAMPLES updates to limit EEPROM wear
+*/
+void SaveModels()
+{
+    for(byte nZone = 0; nZone < 10; ++nZone)
+    {
+        if(g_models[nZone].nLossSamples < MODEL_MIN_SAMPLES || g_models[nZone].nGainSamples < MODEL_MIN_SAMPLES)
+            continue;
+        unsigned int nAddress = nZone * EEPROM_MODEL_SIZE + EEPROM_MODEL_START;
+        byte data[EEPROM_MODEL_SIZE] = {(byte)(g_models[nZone].nLoss >> 8), (byte)(g_models[nZone].nLoss & 0xFF),
+                                        (byte)(g_models[nZone].nGain >> 8), (byte)(g_models[nZone].nGain & 0xFF)};
+        for(byte i = 0; i < EEPROM_MODEL_SIZE; ++i)
+            if(EEPROM.read(nAddress + i) != data[i])
+                EEPROM.write(nAddress + i, data[i]);
+    }
+}
+
+/** @brief  Prints each zone's thermal model to serial port
+*   @note   Shows coefficients, updates of each, predicted change over next MODEL_PERIOD minutes without and with heat
+*           and predicted minutes of heat to reach set-point
+*/
+void ShowModels()
+{
+    int nOutdoor = (g_nOutdoor == OUTDOOR_UNKNOWN) ? MODEL_OUTDOOR_DEFAULT : g_nOutdoor;
+    for(byte nZone = 0; nZone < 10; ++nZone)
+    {
+        model* pModel = &g_models[nZone];
+        int nValue = 0x7FFF;
+        for(unsigned int nSensor = 0; nSensor < g_nSensorQuant; ++nSensor)
+            if(g_sensors[nSensor].nZone == nZone && nSensor != g_nOutdoorSensor)
+            {
+                nValue = g_sensors[nSensor].nValue;
+                break;
+            }
+        Scratch<80> scratchLine;
+        if(!scratchLine.Valid())
+            return;
+        char* sLine = scratchLine.Chars();
+        char* pLine = FormatUnsigned(sLine, nZone);
+        pLine = FormatString(pLine, "  Loss=");
+        pLine = FormatSigned(pLine, pModel->nLoss);
+        pLine = FormatString(pLine, "/");
+        pLine = FormatUnsigned(pLine, pModel->nLossSamples);
+        pLine = FormatString(pLine, " Gain=");
+        pLine = FormatSigned(pLine, pModel->nGain);
+        pLine = FormatString(pLine, "/");
+        pLine = FormatUnsigned(pLine, pModel->nGainSamples);
+        if(nValue != 0x7FFF)
         {
-            if(bUp)
+            int nHeat = PredictRise(pModel, nValue, nOutdoor, MODEL_PERIOD);
+            pLine = FormatString(pLine, " Idle=");
+            pLine = FormatFixed(pLine, PredictRise(pModel, nValue, nOutdoor, 0), 2);
+            pLine = FormatString(pLine, " Heat=");
+            pLine = FormatFixed(pLine, nHeat, 2);
+            long lNeed = (g_zones[nZone].nSetpoint + g_zones[nZone].nCompensation) * 10L - nValue;
+            if(lNeed > 0 && nHeat > 0)
             {
-                if(g_zones[g_nSelectedZone].nSetpoint < 100)
-                    g_zones[g_nSelectedZone].nSetpoint = g_zones[g_nSelectedZone].nSetpoint + 1;
+                long lMinutes = lNeed * MODEL_PERIOD / nHeat;
+                pLine = FormatString(pLine, " Reach=");
+                pLine = FormatUnsigned(pLine, (lMinutes > 999) ? 999 : lMinutes);
+                pLine = FormatString(pLine, "min");
             }
-            else
-                if(g_zones[g_nSelectedZone].nSetpoint > 0)
-                    g_zones[g_nSelectedZone].nSetpoint = g_zones[g_nSelectedZone].nSetpoint - 1;
         }
-        else
+        Serial.println(sLine);
+    }
+}
+
+/** @brief  Gets current time as minutes since 00:00 Sunday
+*   @return <i>unsigned int</i> Minutes since 00:00 Sunday
+*/
+unsigned int GetMinuteOfWeek()
+{
+    unsigned int nMinute = g_tsNow.nTime;
+    for(byte nDay = g_tsNow.nDay; nDay > 1; nDay >>= 1)
+        nMinute += 1440;
+    return nMinute;
+}
+
+#if FEATURE_JOURNAL
+/** @brief  Prints journal status and newest pages to serial port
+*   @param  nPages Quantity of pages to list, newest first
+*/
+void ShowJournal(byte nPages)
+{
+    if(!g_bJournal)
+    {
+        Serial.println("Journal: no chip");
+        return;
+    }
+    Serial.print("Journal page=");
+    Serial.print(g_nJournalPage);
+    Serial.print(" sequence=");
+    Serial.print(g_lJournalSequence);
+    Serial.print(" collected=");
+    Serial.print(g_nJournalCount);
+    Serial.print(" errors=");
+    Serial.println(g_nJournalErrors);
+    Scratch<JOURNAL_PAGE_SIZE> scratchPage;
+    if(!scratchPage.Valid())
+        return;
+    byte* pPage = scratchPage.Bytes();
+    unsigned int nPage = g_nJournalPage;
+    for(byte nCount = 0; nCount < nPages; ++nCount)
+    {
+        nPage = (nPage + JOURNAL_PAGES - 1) % JOURNAL_PAGES;
+        unsigned long lSequence;
+        if(!JournalReadPage(nPage, pPage, &lSequence))
+            break; //Reached oldest page or failed CRC
+        Serial.print("Page ");
+        Serial.print(nPage);
+        Serial.print(" sequence=");
+        Serial.println(lSequence);
+        for(byte nRecord = 0; nRecord < JOURNAL_RECORDS; ++nRecord)
         {
-            if(bUp)
-                g_zones[g_nSelectedZone].nSetpoint = g_nWaterHighTemp;
-            else
-                g_zones[g_nSelectedZone].nSetpoint = g_nWaterLowTemp;
+            journalRecord record;
+            if(!JournalGetRecord(pPage, nRecord, &record))
+                continue;
+            Scratch<32> scratchLine;
+            if(!scratchLine.Valid())
+                return;
+            char* sLine = scratchLine.Chars();
+            char* pLine = FormatString(sLine, " ");
+            pLine = FormatString(pLine, DOW[record.nMinute / 1440 % 7 + 1]);
+            *pLine++ = ' ';
+            pLine = FormatUnsigned(pLine, record.nMinute % 1440 / 60, 2, '0');
+            *pLine++ = ':';
+            pLine = FormatUnsigned(pLine, record.nMinute % 60, 2, '0');
+            switch(record.nType)
+            {
+            case JOURNAL_READING:
+                pLine = FormatString(pLine, " Sensor ");
+                pLine = FormatUnsigned(pLine, record.nArg);
+                *pLine++ = ' ';
+                FormatFixed(pLine, record.nValue, 2);
+                break;
+            case JOURNAL_RELAY:
+                pLine = FormatString(pLine, " Relay ");
+                pLine = FormatUnsigned(pLine, record.nArg);
+                *pLine++ = ' ';
+                pLine = FormatHex(pLine, record.nValue >> 8);
+                FormatHex(pLine, record.nValue & 0xFF);
+                break;
+            default:
+                pLine = FormatString(pLine, " Trace ");
+                pLine = FormatUnsigned(pLine, record.nArg);
+                *pLine++ = ' ';
+                FormatUnsigned(pLine, record.nValue);
+            }
+            Serial.println(sLine);
         }
     }
+}
+#endif // FEATURE_JOURNAL
+
+/** @brief  Prints outdoor sensor, temperature and each zone's compensation curve to serial port */
+void ShowCompensation()
+{
+    Scratch<72> scratchLine;
+    if(!scratchLine.Valid())
+        return;
+    char* sLine = scratchLine.Chars();
+    char* pLine = FormatString(sLine, "Outdoor sensor=");
+    if(g_nOutdoorSensor == OUTDOOR_NONE)
+        pLine = FormatString(pLine, "none");
     else
+        pLine = FormatUnsigned(pLine, g_nOutdoorSensor);
+    if(g_nOutdoor != OUTDOOR_UNKNOWN)
     {
-        if(bUp)
-            ++g_nSelectedZone;
-        else
+        pLine = FormatString(pLine, " ");
+        pLine = FormatFixed(pLine, g_nOutdoor, 1);
+        FormatString(pLine, "C");
+    }
+    Serial.println(sLine);
+    for(byte nZone = 0; nZone < 10; ++nZone)
+    {
+        pLine = FormatUnsigned(sLine, nZone);
+        pLine = FormatString(pLine, "  Comp=");
+        pLine = FormatFixed(pLine, g_zones[nZone].nCompensation, 1);
+        pLine = FormatString(pLine, " Curve=");
+        for(byte nPoint = 0; nPoint < CURVE_POINTS; ++nPoint)
         {
-            if(g_nSelectedZone == 0xFF)
-                g_nSelectedZone = 10;
-            --g_nSelectedZone;
+            unsigned int nAddress = nZone * EEPROM_ZONE_SIZE + EEPROM_ZONE_START + EEPROM_ZONE_CURVE + nPoint * 2;
+            pLine = FormatString(pLine, " ");
+            pLine = FormatSigned(pLine, (signed char)EEPROM.read(nAddress));
+            pLine = FormatString(pLine, ":");
+            pLine = FormatFixed(pLine, (signed char)EEPROM.read(nAddress + 1), 1);
         }
-        if(g_nSelectedZone > 9)
+        Serial.println(sLine);
+    }
+}
+
+/** @brief  Reads a Modbus holding register
+*   @param  nRegister Register address (see MODBUS_REG_ constants)
+*   @param  pValue Pointer to value to populate
+*   @return <i>byte</i> MODBUS_OK on success or exception code
+*/
+byte ModbusReadRegister(unsigned int nRegister, unsigned int* pValue)
+{
+    if(nRegister >= MODBUS_REG_EVENT && nRegister < MODBUS_REG_EVENT + MAX_EVENTS * 4)
+    {
+        event* pEvent = &g_events[(nRegister - MODBUS_REG_EVENT) / 4];
+        switch((nRegister - MODBUS_REG_EVENT) % 4)
         {
-            g_nSelectedZone = 0xFF;
-            getTime(true);
-            return;
+        case 0:
+            *pValue = pEvent->nDays;
+            break;
+        case 1:
+            *pValue = pEvent->nTime;
+            break;
+        case 2:
+            *pValue = pEvent->nZone;
+            break;
+        default:
+            *pValue = pEvent->nValue;
         }
-        timerDisplayTimeout.start(TIMEOUT_MENU, true);
+        return MODBUS_OK;
     }
-    g_lcd.clear();
-    for(unsigned int i = 0; i < 10; ++i)
-        g_lcd.print(char(g_zones[g_nSelectedZone].sName[i]));
-    g_lcd.print(" ");
-    int nValue = 999;
+    if(nRegister >= MODBUS_REG_SENSOR_VALUE && nRegister < MODBUS_REG_SENSOR_VALUE + MAX_SENSORS)
+        *pValue = g_sensors[nRegister - MODBUS_REG_SENSOR_VALUE].nValue;
+    else if(nRegister >= MODBUS_REG_SETPOINT && nRegister < MODBUS_REG_SETPOINT + 10)
+        *pValue = g_zones[nRegister - MODBUS_REG_SETPOINT].nSetpoint;
+    else if(nRegister >= MODBUS_REG_SENSOR_ZONE && nRegister < MODBUS_REG_SENSOR_ZONE + MAX_SENSORS)
+        *pValue = g_sensors[nRegister - MODBUS_REG_SENSOR_ZONE].nZone;
+    else if(nRegister >= MODBUS_REG_HYST && nRegister < MODBUS_REG_HYST + 10)
+        *pValue = g_zones[nRegister - MODBUS_REG_HYST].nHyst;
+    else if(nRegister >= MODBUS_REG_SPACE && nRegister < MODBUS_REG_SPACE + 10)
+        *pValue = g_zones[nRegister - MODBUS_REG_SPACE].bSpace ? 1 : 0;
+    else if(nRegister >= MODBUS_REG_LOSS && nRegister < MODBUS_REG_LOSS + 10)
+        *pValue = g_models[nRegister - MODBUS_REG_LOSS].nLoss;
+    else if(nRegister >= MODBUS_REG_GAIN && nRegister < MODBUS_REG_GAIN + 10)
+        *pValue = g_models[nRegister - MODBUS_REG_GAIN].nGain;
+    else if(nRegister == MODBUS_REG_RELAYS)
+        *pValue = (FastPin<PIN_BOILER>::Port() & FastPin<PIN_BOILER>::MASK ? 1 : 0) | (FastPin<PIN_PUMP>::Port() & FastPin<PIN_PUMP>::MASK ? 2 : 0);
+    else if(nRegister == MODBUS_REG_DEMAND)
+        *pValue = GetZoneDemand();
+    else if(nRegister == MODBUS_REG_VALVES)
+        *pValue = g_valves.Read();
+    else if(nRegister == MODBUS_REG_TIME)
+        *pValue = g_tsNow.nTime;
+    else if(nRegister == MODBUS_REG_DAY)
+        *pValue = g_tsNow.nDay;
+    else if(nRegister == MODBUS_REG_SENSOR_QUANT)
+        *pValue = g_nSensorQuant;
+    else if(nRegister == MODBUS_REG_EVENT_QUANT)
+        *pValue = g_nEventQuant;
+    else if(nRegister >= MODBUS_REG_HASH + 4 && nRegister < MODBUS_REG_HASH + 4 + MAX_EVENTS / EVENT_BLOCK_SIZE)
+        *pValue = g_nHashEvents[nRegister - MODBUS_REG_HASH - 4];
+    else if(nRegister == MODBUS_REG_HASH)
+        *pValue = g_nHashSensors;
+    else if(nRegister == MODBUS_REG_HASH + 1)
+        *pValue = g_nHashZones;
+    else if(nRegister == MODBUS_REG_HASH + 2)
+        *pValue = g_nHashSettings;
+    else if(nRegister == MODBUS_REG_HASH + 3)
+        *pValue = GetEventHash();
+    else if(nRegister == MODBUS_REG_FILTER)
+        *pValue = g_nFilterShift;
+    else if(nRegister == MODBUS_REG_ADDRESS)
+        *pValue = g_nModbusAddress;
+    else if(nRegister == MODBUS_REG_OUTDOOR)
+        *pValue = g_nOutdoorSensor;
+    else if(nRegister == MODBUS_REG_PRIORITY)
+        *pValue = g_scheduler.nPriority;
+    else if(nRegister == MODBUS_REG_MAX_HOLD)
+        *pValue = g_scheduler.nMaxHold;
+    else if(nRegister == MODBUS_REG_TRANSITIONS)
+        *pValue = g_scheduler.nTransitions;
+    else if(nRegister == MODBUS_REG_STARTS)
+        *pValue = g_scheduler.nStarts;
+    else if(nRegister == MODBUS_REG_BATCHED)
+        *pValue = g_scheduler.nBatched;
+    else if(nRegister == MODBUS_REG_BATCH)
+        *pValue = g_scheduler.bBatch ? 1 : 0;
+    else if(nRegister == MODBUS_REG_TUNE_RATE)
+        *pValue = g_nTuneRate;
+    else if(nRegister == MODBUS_REG_TUNE_MIN)
+        *pValue = g_nTuneMin;
+    else if(nRegister == MODBUS_REG_TUNE_MAX)
+        *pValue = g_nTuneMax;
+    else if(nRegister == MODBUS_REG_OPTIMISE)
+        *pValue = 0;
+    else
+        return MODBUS_ILLEGAL_ADDRESS;
+    return MODBUS_OK;
+}
 
-    for(unsigned int i = 0; i < g_nSensorQuant; ++i)
+/** @brief  Writes a Modbus holding register
+*   @param  nRegister Register address (see MODBUS_REG_ constants)
+*   @param  nValue Value to write
+*   @param  bTest True to validate without writing
+*   @return <i>byte</i> MODBUS_OK on success or exception code
+*   @note   Configuration is saved to EEPROM. Writing all four registers of event at index g_nEventQuant in one request
+*           appends a new event. A partial write there is rejected so no event is scheduled before all its fields are set.
+*/
+byte ModbusWriteRegister(unsigned int nRegister, unsigned int nValue, bool bTest)
+{
+    if(nRegister >= MODBUS_REG_EVENT && nRegister < MODBUS_REG_EVENT + MAX_EVENTS * 4)
+    {
+        byte nEvent = (nRegister - MODBUS_REG_EVENT) / 4;
+        byte nField = (nRegister - MODBUS_REG_EVENT) % 4;
+        if(nEvent > g_nEventQuant)
+            return MODBUS_ILLEGAL_ADDRESS; //Events must be contiguous
+        if((nField == 0 && nValue > 0xFF) || (nField == 1 && nValue >= 24 * 60) || (nField == 2 && nValue > 9))
+            return MODBUS_ILLEGAL_VALUE;
+        if(nEvent == g_nEventQuant)
+        {
+            unsigned int nBase = nRegister - nField;
+            unsigned int nDays, nTime, nZone, nSetpoint;
+            if(!ModbusGetWriteValue(nBase, &nDays) || !ModbusGetWriteValue(nBase + 1, &nTime)
+                || !ModbusGetWriteValue(nBase + 2, &nZone) || !ModbusGetWriteValue(nBase + 3, &nSetpoint))
+                return MODBUS_ILLEGAL_ADDRESS; //New event must be written in full
+            if(nDays == 0)
+                return MODBUS_ILLEGAL_VALUE;
+            if(bTest)
+                return MODBUS_OK;
+            AddEvent(nZone, nDays, nTime, nSetpoint); //All fields set together. Writes of remaining registers find them unchanged
+            ProcessEvents();
+            return MODBUS_OK;
+        }
+        if(bTest)
+            return MODBUS_OK;
+        if(nField == 0 && nValue == 0)
+        {
+            DeleteEvent(nEvent);
+            ProcessEvents();
+            return MODBUS_OK;
+        }
+        event* pEvent = &g_events[nEvent];
+        switch(nField)
+        {
+        case 0:
+            pEvent->nDays = nValue;
+            break;
+        case 1:
+            pEvent->nTime = nValue;
+            break;
+        case 2:
+            pEvent->nZone = nValue;
+            break;
+        default:
+            pEvent->nValue = nValue;
+        }
+        SaveEvent(nEvent);
+        ProcessEvents();
+        return MODBUS_OK;
+    }
+    if(nRegister >= MODBUS_REG_SETPOINT && nRegister < MODBUS_REG_SETPOINT + 10)
     {
-        if((g_sensors[i].nZone == g_nSelectedZone) && (g_sensors[i].nValue < nValue))
-            nValue = g_sensors[i].nValue;
+        if(!bTest)
+            g_zones[nRegister - MODBUS_REG_SETPOINT].nSetpoint = nValue;
     }
-
-    if(nValue == 999)
-        g_lcd.print("??.?C");
-    else
+    else if(nRegister >= MODBUS_REG_SENSOR_ZONE && nRegister < MODBUS_REG_SENSOR_ZONE + MAX_SENSORS)
     {
-        unsigned int nUnits = nValue / 10;
-        if(nUnits < 10)
-            g_lcd.print(" ");
-        g_lcd.print(nUnits);
-        g_lcd.print(".");
-        g_lcd.print(nValue - nUnits * 10);
-        g_lcd.print("C");
-    }
-    g_lcd.setCursor(0,1);
-    g_lcd.print("Setpoint: ");
-    unsigned int nUnits = g_zones[g_nSelectedZone].nSetpoint / 10;
-    if(nUnits < 10)
-        g_lcd.print(" ");
-    g_lcd.print(nUnits);
-    g_lcd.print(".");
-    g_lcd.print(g_zones[g_nSelectedZone].nSetpoint - nUnits * 10);
-    g_lcd.print("C");
-    g_lcd.setCursor(13, 1);
-}
-
-void OnButtonOk(bool bState)
-{
-    if(bState)
-        return;
-    if(g_nSelectedZone == 0xFF)
-        return;
-    if(!g_bEdit)
+        if(nRegister - MODBUS_REG_SENSOR_ZONE >= g_nSensorQuant)
+            return MODBUS_ILLEGAL_ADDRESS;
+        if(nValue > 9)
+            return MODBUS_ILLEGAL_VALUE;
+        if(!bTest)
+        {
+            g_sensors[nRegister - MODBUS_REG_SENSOR_ZONE].nZone = nValue;
+            SaveSensor(nRegister - MODBUS_REG_SENSOR_ZONE);
+        }
+    }
+    else if(nRegister >= MODBUS_REG_HYST && nRegister < MODBUS_REG_HYST + 10)
+    {
+        if(nValue > 0xFF)
+            return MODBUS_ILLEGAL_VALUE;
+        if(!bTest)
+        {
+            g_zones[nRegister - MODBUS_REG_HYST].nHyst = nValue;
+            SaveZone(nRegister - MODBUS_REG_HYST);
+        }
+    }
+    else if(nRegister >= MODBUS_REG_SPACE && nRegister < MODBUS_REG_SPACE + 10)
+    {
+        if(nValue > 1)
+            return MODBUS_ILLEGAL_VALUE;
+        if(!bTest)
+        {
+            g_zones[nRegister - MODBUS_REG_SPACE].bSpace = nValue;
+            SaveZone(nRegister - MODBUS_REG_SPACE, false);
+        }
+    }
+    else if(nRegister == MODBUS_REG_FILTER)
+    {
+        if(nValue > FILTER_MAX_SHIFT)
+            return MODBUS_ILLEGAL_VALUE;
+        if(!bTest)
+            SetFilterShift(nValue);
+    }
+    else if(nRegister == MODBUS_REG_ADDRESS)
+    {
+        if(nValue > MODBUS_MAX_ADDRESS)
+            return MODBUS_ILLEGAL_VALUE;
+        if(!bTest)
+            SetModbusAddress(nValue); //Takes effect after response is sent
+    }
+    else if(nRegister == MODBUS_REG_OUTDOOR)
+    {
+        if(nValue >= MAX_SENSORS && nValue != OUTDOOR_NONE)
+            return MODBUS_ILLEGAL_VALUE;
+        if(!bTest)
+            SetOutdoorSensor(nValue);
+    }
+    else if(nRegister == MODBUS_REG_PRIORITY)
+    {
+        if(nValue > 0x3FF)
+            return MODBUS_ILLEGAL_VALUE;
+        if(!bTest)
+            SetPriority(nValue, g_scheduler.nMaxHold, g_scheduler.bBatch);
+    }
+    else if(nRegister == MODBUS_REG_MAX_HOLD)
     {
-        g_bEdit = true;
-        g_lcd.blink();
-        timerDisplayTimeout.start(TIMEOUT_EDIT, true);
+        if(nValue > 0xFE)
+            return MODBUS_ILLEGAL_VALUE;
+        if(!bTest)
+            SetPriority(g_scheduler.nPriority, nValue, g_scheduler.bBatch);
+    }
+    else if(nRegister == MODBUS_REG_BATCH)
+    {
+        if(nValue > 1)
+            return MODBUS_ILLEGAL_VALUE;
+        if(!bTest)
+            SetPriority(g_scheduler.nPriority, g_scheduler.nMaxHold, nValue);
+    }
+    else if(nRegister == MODBUS_REG_TUNE_RATE)
+    {
+        if(nValue > TUNE_MAX_RATE)
+            return MODBUS_ILLEGAL_VALUE;
+        if(!bTest)
+            SetTuning(nValue, g_nTuneMin, g_nTuneMax);
+    }
+    else if(nRegister == MODBUS_REG_TUNE_MIN || nRegister == MODBUS_REG_TUNE_MAX)
+    {
+        //Check limits against each other as written by this request so both may move past the current values together
+        unsigned int nMin = g_nTuneMin;
+        unsigned int nMax = g_nTuneMax;
+        ModbusGetWriteValue(MODBUS_REG_TUNE_MIN, &nMin);
+        ModbusGetWriteValue(MODBUS_REG_TUNE_MAX, &nMax);
+        if(nMin > nMax || nMax > 0xFE)
+            return MODBUS_ILLEGAL_VALUE;
+        if(!bTest)
+            SetTuning(g_nTuneRate, nMin, nMax);
+    }
+    else if(nRegister == MODBUS_REG_OPTIMISE)
+    {
+        if(nValue != 1)
+            return MODBUS_ILLEGAL_VALUE;
+        if(!bTest)
+        {
+            OptimiseEvents();
+            ProcessEvents();
+        }
     }
     else
     {
-        g_lcd.noBlink();
-        g_bEdit = false;
+        unsigned int nDummy;
+        return ModbusReadRegister(nRegister, &nDummy) == MODBUS_OK ? MODBUS_ILLEGAL_VALUE : MODBUS_ILLEGAL_ADDRESS; //Read only or absent
     }
+    return MODBUS_OK;
 }
 
-void ToggleEdit()
+/** @brief  Gets zones calling for heat
+*   @return <i>unsigned int</i> Bitwise flag of zones calling for heat. Bit 0 = zone 0.
+*/
+unsigned int GetZoneDemand()
 {
-    if(g_bEdit)
-    {
-        g_bEdit = false;
-        g_lcd.noBlink();
-        timerDisplayTimeout.start(TIMEOUT_EDIT);
-    }
-    else
+    unsigned int nDemand = 0;
+    for(byte nZone = 0; nZone < 10; ++nZone)
+        if(g_zones[nZone].bOn)
+            nDemand |= 1 << nZone;
+    return nDemand;
+}
+
+#if FEATURE_BENCHMARK
+/** @brief  Times primitives used by control loop and reports to serial port
+*   @param  nCount Quantity of repetitions of each primitive
+*   @note   Configuration is unchanged: EEPROM write is to spare slot EEPROM_BENCHMARK (one write per run, rated
+*           100,000 writes), event record save finds no changed bytes so writes nothing, RTC read is not decoded and LCD
+*           is redrawn afterwards
+*/
+void Benchmark(byte nCount)
+{
+    if(nCount == 0)
+        return;
+    timing timingOneWire, timingEeprom, timingRecord, timingRtc, timingLcd;
+    ResetTiming(&timingOneWire);
+    ResetTiming(&timingEeprom);
+    ResetTiming(&timingRecord);
+    ResetTiming(&timingRtc);
+    ResetTiming(&timingLcd);
+    Scratch<9> scratchData;
+    if(!scratchData.Valid())
+        return;
+    byte* data = scratchData.Bytes();
+    for(byte nRun = 0; nRun < nCount; ++nRun)
     {
-        g_nSelectedZone = 0xFF;
-        getTime(true);
-        timerDisplayTimeout.start(TIMEOUT_MENU);
+        //1-Wire sweep: read scratchpad of every sensor as GetTemperature does (excludes conversion time)
+        unsigned long lStart = micros();
+        for(unsigned int nSensor = 0; nSensor < g_nSensorQuant; ++nSensor)
+            ReadScratchpad(g_sensors[nSensor].address, data);
+        AddTiming(&timingOneWire, lStart);
+
+        //EEPROM byte write, the cost of each changed byte of a record save
+        byte nValue = EEPROM.read(EEPROM_BENCHMARK);
+        lStart = micros();
+        EEPROM.write(EEPROM_BENCHMARK, nValue);
+        AddTiming(&timingEeprom, lStart);
+
+        //Unchanged event record save (compare and hash update only)
+        if(g_nEventQuant)
+        {
+            lStart = micros();
+            SaveEvent(0);
+            AddTiming(&timingRecord, lStart);
+        }
+
+        //RTC read as getTime does
+        TwiWait();
+        lStart = micros();
+        if(requestTime())
+            TwiWait();
+        AddTiming(&timingRtc, lStart);
+
+#if FEATURE_LCD
+        //LCD redraw of two full lines
+        lStart = micros();
+        UiTest();
+        AddTiming(&timingLcd, lStart);
+#endif // FEATURE_LCD
     }
+    Serial.print("Benchmark runs=");
+    Serial.print(nCount);
+    Serial.print(" sensors=");
+    Serial.println(g_nSensorQuant);
+    ReportTiming("1-Wire sweep", &timingOneWire, nCount);
+    ReportTiming("EEPROM write", &timingEeprom, nCount);
+    if(g_nEventQuant)
+        ReportTiming("Event save", &timingRecord, nCount);
+    ReportTiming("RTC read", &timingRtc, nCount);
+#if FEATURE_LCD
+    ReportTiming("LCD redraw", &timingLcd, nCount);
+    UiHome(); //Restore clock display
+#endif // FEATURE_LCD
+}
+
+/** @brief  Clears timing statistics
+*   @param  pTiming Pointer to timing statistics
+*/
+void ResetTiming(timing* pTiming)
+{
+    pTiming->lMin = 0xFFFFFFFF;
+    pTiming->lMax = 0;
+    pTiming->lTotal = 0;
+}
+
+/** @brief  Adds a duration to timing statistics
+*   @param  pTiming Pointer to timing statistics
+*   @param  lStart Value of micros() at start of timed operation
+*/
+void AddTiming(timing* pTiming, unsigned long lStart)
+{
+    unsigned long lDuration = micros() - lStart;
+    if(lDuration < pTiming->lMin)
+        pTiming->lMin = lDuration;
+    if(lDuration > pTiming->lMax)
+        pTiming->lMax = lDuration;
+    pTiming->lTotal += lDuration;
+}
+
+/** @brief  Prints timing statistics to serial port
+*   @param  sName Name of timed operation
+*   @param  pTiming Pointer to timing statistics
+*   @param  nCount Quantity of durations added
+*/
+void ReportTiming(const char* sName, timing* pTiming, byte nCount)
+{
+    Serial.print(sName);
+    Serial.print(" min=");
+    Serial.print(pTiming->lMin);
+    Serial.print(" avg=");
+    Serial.print(pTiming->lTotal / nCount);
+    Serial.print(" max=");
+    Serial.print(pTiming->lMax);
+    Serial.println("us");
 }
+#endif // FEATURE_BENCHMARK
@@ -2,13 +2,22 @@ void ReadConfig();
 bool ReadSerial();
 void ParseSerial();
 void SaveEvent(unsigned int nEvent);
-void SaveZone(unsigned int nZone);
+void SaveZone(unsigned int nZone, bool bHyst = true);
 void SaveSensor(unsigned int nSensor);
+void SaveSetting(unsigned int nOffset, byte nValue);
+unsigned int RecordCrc(unsigned int nAddress, byte nSize, byte nIndex, bool bSkipEmpty);
+unsigned int GetEventHash();
 void AddSensor(byte* pAddress, byte nZone);
 void Scan();
-int GetTemperature(byte* pAddress);
-bool GetTemperature(unsigned int nSensor);
-byte getTime(bool bShow);
+int GetTemperature(byte* pAddress, byte nSensor = 0xFF, bool bConvert = true);
+void ConvertTemperature(byte* pAddress);
+void StartConversion();
+void WaitConversion();
+bool ReadScratchpad(byte* pAddress, byte* pData);
+bool GetTemperature(unsigned int nSensor, bool bConvert = true);
+byte getTime(bool bShow, bool bPrint = false);
+bool requestTime();
+byte decodeTime(bool bShow, bool bPrint);
 void setTime(unsigned int nHour, unsigned int nMinute, unsigned int nSecond);
 void setDate(unsigned int nDow, unsigned int nDay, unsigned int nMonth, unsigned int nYear);
 byte decToBcd(byte nValue);
@@ -16,7 +25,26 @@ byte bcdToDec(byte nValue);
 void ProcessEvents();
 void AddEvent(byte nZone, byte nDays, unsigned int nTime, int nSetpoint, bool bSave = true);
 void DeleteEvent(byte nEvent);
+void ClearEvent(byte nEvent);
+byte OptimiseEvents();
+void ReportOptimiseEvents(byte nRemoved);
 byte CharToHex(char nChar);
-void OnButtonOk(bool bState);
-void OnButtonUpDown(bool bUp);
-void ToggleEdit();
+void Benchmark(byte nCount);
+void SetFilterShift(byte nShift);
+void SetModbusAddress(byte nAddress);
+void SetPriority(unsigned int nPriority, byte nMaxHold, bool bBatch);
+void SetOutdoorSensor(byte nSensor);
+void SetTuning(byte nRate, byte nMin, byte nMax);
+void SaveTunedHyst(byte nZone);
+void ShowTuning();
+void SaveCurvePoint(byte nZone, byte nPoint, signed char nOutdoor, signed char nOffset);
+void UpdateCompensation();
+void ShowCompensation();
+void SaveModels();
+void ShowModels();
+unsigned int GetMinuteOfWeek();
+void ShowJournal(byte nPages);
+unsigned int GetZoneDemand();
+void ResetTiming(struct timing* pTiming);
+void AddTiming(struct timing* pTiming, unsigned long lStart);
+void ReportTiming(const char* sName, struct timing* pTiming, byte nCount);
@@ -0,0 +1,252 @@
+/** riban heating controller - external EEPROM journal
+*   Page layout: sequence (3 bytes, big-endian), CRC-8 of the rest of the page, then JOURNAL_RECORDS records of
+*   type, argument, minute (2 bytes) and value (2 bytes). Page n of each lap holds sequence (first page of lap) + n so
+*   the pages written in the current lap are the longest prefix whose sequence follows that of page 0.
+*   A failed page write is retried at the same page with the next batch so no gap breaks the prefix.
+*/
+
+#include "journal.h"
+#include <string.h>
+
+#if FEATURE_JOURNAL
+
+#ifdef ARDUINO
+#include "twi.h"
+#endif // ARDUINO
+
+byte g_journalPage[2 + JOURNAL_PAGE_SIZE]; //Chip address (big-endian) then page being collected
+bool g_bJournal = false;
+unsigned int g_nJournalPage = 0;
+unsigned long g_lJournalSequence = 0;
+byte g_nJournalCount = 0;
+unsigned int g_nJournalErrors = 0;
+
+#ifdef ARDUINO
+
+unsigned long g_lJournalWrite = 0; //millis() at end of last page write
+
+/** @brief  Waits for bus and for chip to finish its write cycle */
+static void ChipWait()
+{
+    TwiWait();
+    while(millis() - g_lJournalWrite < JOURNAL_WRITE_MS)
+        ;
+}
+
+/** @brief  Writes a page to chip
+*   @param  pBuffer Pointer to chip address followed by page content
+*   @param  nLength Quantity of bytes in buffer
+*   @return <i>bool</i> True on success
+*   @note   Blocks for the transfer (about 7ms) which is no longer than TWI timeout
+*/
+static bool ChipWrite(const byte* pBuffer, byte nLength)
+{
+    ChipWait();
+    bool bSuccess = TwiStart(JOURNAL_I2C_ADDRESS, pBuffer, nLength) && TwiWait();
+    g_lJournalWrite = millis();
+    return bSuccess;
+}
+
+/** @brief  Reads from chip
+*   @param  nAddress Chip address
+*   @param  pData Pointer to buffer to populate
+*   @param  nLength Quantity of bytes to read
+*   @return <i>bool</i> True on success. False if chip does not respond.
+*/
+static bool ChipRead(unsigned int nAddress, byte* pData, byte nLength)
+{
+    byte address[2] = {(byte)(nAddress >> 8), (byte)(nAddress & 0xFF)};
+    ChipWait();
+    return TwiStart(JOURNAL_I2C_ADDRESS, address, 2, pData, nLength) && TwiWait();
+}
+
+#else
+
+byte g_journalChip[(unsigned long)JOURNAL_PAGES * JOURNAL_PAGE_SIZE];
+bool g_bJournalChipErased = false; //True once stand-in is initialised to erased state
+
+/** @brief  Erases host stand-in on first access, as a new chip */
+static void ChipErase()
+{
+    if(g_bJournalChipErased)
+        return;
+    memset(g_journalChip, 0xFF, sizeof(g_journalChip));
+    g_bJournalChipErased = true;
+}
+
+static bool ChipWrite(const byte* pBuffer, byte nLength)
+{
+    ChipErase();
+    memcpy(g_journalChip + ((pBuffer[0] << 8) | pBuffer[1]), pBuffer + 2, nLength - 2);
+    return true;
+}
+
+static bool ChipRead(unsigned int nAddress, byte* pData, byte nLength)
+{
+    ChipErase();
+    memcpy(pData, g_journalChip + nAddress, nLength);
+    return true;
+}
+
+#endif // ARDUINO
+
+/** @brief  Calculates CRC-8 (Dallas/Maxim) of a page excluding its CRC byte
+*   @param  pPage Pointer to page
+*   @return <i>byte</i> CRC
+*/
+static byte PageCrc(const byte* pPage)
+{
+    byte nCrc = 0;
+    for(byte i = 0; i < JOURNAL_PAGE_SIZE; ++i)
+    {
+        if(i == JOURNAL_HEADER_SIZE - 1)
+            continue;
+        byte nByte = pPage[i];
+        for(byte nBit = 0; nBit < 8; ++nBit)
+        {
+            byte nMix = (nCrc ^ nByte) & 0x01;
+            nCrc >>= 1;
+            if(nMix)
+                nCrc ^= 0x8C;
+            nByte >>= 1;
+        }
+    }
+    return nCrc;
+}
+
+/** @brief  Reads sequence of a page
+*   @param  nPage Page index
+*   @param  pSequence Pointer to sequence to populate
+*   @return <i>bool</i> True on success
+*/
+static bool ReadSequence(unsigned int nPage, unsigned long* pSequence)
+{
+    byte header[JOURNAL_HEADER_SIZE];
+    if(!ChipRead(nPage * JOURNAL_PAGE_SIZE, header, JOURNAL_HEADER_SIZE))
+        return false;
+    *pSequence = ((unsigned long)header[0] << 16) | ((unsigned int)header[1] << 8) | header[2];
+    return true;
+}
+
+/** @brief  Finds newest page
+*   @return <i>bool</i> True if chip found
+*   @note   Binary search reads log2(JOURNAL_PAGES) + 1 page headers
+*/
+bool JournalBegin()
+{
+    g_bJournal = false;
+    g_nJournalCount = 0;
+    unsigned long lFirst;
+    if(!ReadSequence(0, &lFirst))
+        return false; //No chip
+    g_bJournal = true;
+    if(lFirst == JOURNAL_ERASED)
+    {
+        g_nJournalPage = 0;
+        g_lJournalSequence = 0;
+        return true;
+    }
+    unsigned int nLow = 0; //Last page known to be in current lap
+    unsigned int nHigh = JOURNAL_PAGES; //First page known not to be in current lap
+    while(nHigh - nLow > 1)
+    {
+        unsigned int nMid = (nLow + nHigh) / 2;
+        unsigned long lSequence;
+        if(!ReadSequence(nMid, &lSequence))
+        {
+            g_bJournal = false;
+            return false;
+        }
+        if(lSequence == ((lFirst + nMid) & JOURNAL_ERASED))
+            nLow = nMid;
+        else
+            nHigh = nMid;
+    }
+    g_nJournalPage = (nLow + 1) % JOURNAL_PAGES;
+    g_lJournalSequence = (lFirst + nLow + 1) & JOURNAL_ERASED;
+    return true;
+}
+
+/** @brief  Adds a record, writing page to chip when full
+*   @param  nType Record type (JOURNAL_READING, JOURNAL_RELAY or JOURNAL_TRACE)
+*   @param  nArg Argument dependent on type
+*   @param  nMinute Minutes since 00:00 Sunday
+*   @param  nValue Value dependent on type
+*/
+void JournalAdd(byte nType, byte nArg, unsigned int nMinute, int nValue)
+{
+    if(!g_bJournal)
+        return;
+    byte* pRecord = g_journalPage + 2 + JOURNAL_HEADER_SIZE + g_nJournalCount * JOURNAL_RECORD_SIZE;
+    pRecord[0] = nType;
+    pRecord[1] = nArg;
+    pRecord[2] = nMinute >> 8;
+    pRecord[3] = nMinute & 0xFF;
+    pRecord[4] = (unsigned int)nValue >> 8;
+    pRecord[5] = nValue & 0xFF;
+    if(++g_nJournalCount >= JOURNAL_RECORDS)
+        JournalFlush();
+}
+
+/** @brief  Writes collected records to next page
+*   @return <i>bool</i> True if a page was written
+*   @note   Unused records of a partly filled page are marked JOURNAL_EMPTY. Records are discarded if write fails.
+*/
+bool JournalFlush()
+{
+    if(!g_bJournal || !g_nJournalCount)
+        return false;
+    byte* pPage = g_journalPage + 2;
+    memset(pPage + JOURNAL_HEADER_SIZE + g_nJournalCount * JOURNAL_RECORD_SIZE, JOURNAL_EMPTY,
+        JOURNAL_PAGE_SIZE - JOURNAL_HEADER_SIZE - g_nJournalCount * JOURNAL_RECORD_SIZE);
+    unsigned int nAddress = g_nJournalPage * JOURNAL_PAGE_SIZE;
+    g_journalPage[0] = nAddress >> 8;
+    g_journalPage[1] = nAddress & 0xFF;
+    pPage[0] = g_lJournalSequence >> 16;
+    pPage[1] = (g_lJournalSequence >> 8) & 0xFF;
+    pPage[2] = g_lJournalSequence & 0xFF;
+    pPage[JOURNAL_HEADER_SIZE - 1] = PageCrc(pPage);
+    g_nJournalCount = 0;
+    if(!ChipWrite(g_journalPage, sizeof(g_journalPage)))
+    {
+        ++g_nJournalErrors;
+        return false;
+    }
+    g_nJournalPage = (g_nJournalPage + 1) % JOURNAL_PAGES;
+    g_lJournalSequence = (g_lJournalSequence + 1) & JOURNAL_ERASED;
+    return true;
+}
+
+/** @brief  Reads a page from chip
+*   @param  nPage Page index
+*   @param  pPage Pointer to buffer of JOURNAL_PAGE_SIZE bytes to populate
+*   @param  pSequence Pointer to sequence to populate
+*   @return <i>bool</i> True if page has been written and passes CRC
+*/
+bool JournalReadPage(unsigned int nPage, byte* pPage, unsigned long* pSequence)
+{
+    if(!g_bJournal || nPage >= JOURNAL_PAGES || !ChipRead(nPage * JOURNAL_PAGE_SIZE, pPage, JOURNAL_PAGE_SIZE))
+        return false;
+    *pSequence = ((unsigned long)pPage[0] << 16) | ((unsigned int)pPage[1] << 8) | pPage[2];
+    return *pSequence != JOURNAL_ERASED && pPage[JOURNAL_HEADER_SIZE - 1] == PageCrc(pPage);
+}
+
+/** @brief  Decodes a record from a page
+*   @param  pPage Pointer to page read by JournalReadPage
+*   @param  nRecord Index of record within page
+*   @param  pRecord Pointer to record to populate
+*   @return <i>bool</i> True if record is used
+*/
+bool JournalGetRecord(const byte* pPage, byte nRecord, journalRecord* pRecord)
+{
+    if(nRecord >= JOURNAL_RECORDS)
+        return false;
+    const byte* pData = pPage + JOURNAL_HEADER_SIZE + nRecord * JOURNAL_RECORD_SIZE;
+    pRecord->nType = pData[0];
+    pRecord->nArg = pData[1];
+    pRecord->nMinute = (pData[2] << 8) | pData[3];
+    pRecord->nValue = (int16_t)((pData[4] << 8) | pData[5]);
+    return pRecord->nType != JOURNAL_EMPTY;
+}
+
+#endif // FEATURE_JOURNAL
@@ -0,0 +1,70 @@
+/** riban heating controller - external EEPROM journal
+*   Circular log of sensor readings, relay transitions and trace records in a 24LC series I2C EEPROM on the RTC bus.
+*   Records are collected in RAM and written a full 64 byte page at a time, each page starting with a sequence number
+*   so that the newest page is found at start-up by binary search rather than a scan of the chip.
+*   Record time is minutes since 00:00 Sunday. Pages are written at least hourly so a reader counts week roll-overs
+*   where time decreases between consecutive pages.
+*   Has no dependency on Arduino libraries except the chip access which, in host builds, is replaced by a RAM stand-in.
+*   When FEATURE_JOURNAL is disabled the functions are empty.
+*/
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#ifdef ARDUINO
+#include "Arduino.h"
+#else
+#include <stdint.h>
+typedef uint8_t byte;
+#endif // ARDUINO
+#include "feature.h"
+
+const byte JOURNAL_I2C_ADDRESS = 0x50; //24LC series with A0-A2 low
+const byte JOURNAL_PAGE_SIZE = 64; //Bytes in each chip write page
+const unsigned int JOURNAL_PAGES = 512; //Quantity of pages in chip (24LC256)
+const byte JOURNAL_HEADER_SIZE = 4; //Sequence (24-bit) and CRC at start of each page
+const byte JOURNAL_RECORD_SIZE = 6;
+const byte JOURNAL_RECORDS = (JOURNAL_PAGE_SIZE - JOURNAL_HEADER_SIZE) / JOURNAL_RECORD_SIZE; //Records in each page
+const unsigned long JOURNAL_ERASED = 0xFFFFFF; //Sequence of page never written
+const byte JOURNAL_WRITE_MS = 5; //Chip write cycle (ms) during which it does not acknowledge
+
+//Record types
+const byte JOURNAL_EMPTY = 0xFF; //Unused record in a page written before it was full
+const byte JOURNAL_READING = 1; //Sensor reading. Argument = sensor, value = temperature (C/100)
+const byte JOURNAL_RELAY = 2; //Relay transition. Argument = boiler (bit 0) and pump (bit 1), value = bitwise flag of open valves
+const byte JOURNAL_TRACE = 3; //Trace. Argument = JOURNAL_TRACE_x code, value depends on code
+
+//Trace codes
+const byte JOURNAL_TRACE_START = 0; //Controller started. Value = number of pages found in journal
+const byte JOURNAL_TRACE_EVENT = 1; //Scheduled event applied. Value = event index
+
+struct journalRecord
+{
+    byte nType; //JOURNAL_x record type
+    byte nArg; //Sensor, relay state or trace code
+    unsigned int nMinute; //Minutes since 00:00 Sunday
+    int nValue; //Value dependent on type
+};
+
+#if FEATURE_JOURNAL
+bool JournalBegin();
+void JournalAdd(byte nType, byte nArg, unsigned int nMinute, int nValue);
+bool JournalFlush();
+bool JournalReadPage(unsigned int nPage, byte* pPage, unsigned long* pSequence);
+bool JournalGetRecord(const byte* pPage, byte nRecord, journalRecord* pRecord);
+
+extern bool g_bJournal; //True if chip found
+extern unsigned int g_nJournalPage; //Page written next
+extern unsigned long g_lJournalSequence; //Sequence of page written next
+extern byte g_nJournalCount; //Quantity of records waiting to be written
+extern unsigned int g_nJournalErrors; //Quantity of failed page writes
+#ifndef ARDUINO
+extern byte g_journalChip[]; //Host stand-in for chip content
+extern bool g_bJournalChipErased; //False until stand-in is first accessed, when it is erased. Set true after loading an image.
+#endif // ARDUINO
+#else
+inline bool JournalBegin() { return false; }
+inline void JournalAdd(byte, byte, unsigned int, int) {}
+inline bool JournalFlush() { return false; }
+#endif // FEATURE_JOURNAL
+
+#endif // JOURNAL_H
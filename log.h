@@ -0,0 +1,44 @@
+/** riban heating controller - leveled logging
+*   Diagnostic output is wrapped in LOG_IF(level, category) { ... }. Levels above LOG_LEVEL are removed at compile time
+*   (define LOG_LEVEL in build options to change). Remaining output is filtered at runtime by verbosity and category mask.
+*/
+#ifndef LOG_H
+#define LOG_H
+
+#include "Arduino.h"
+
+#define LOG_NONE 0
+#define LOG_ERROR 1
+#define LOG_WARN 2
+#define LOG_INFO 3
+#define LOG_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_INFO //Highest level compiled into image
+#endif // LOG_LEVEL
+
+const byte LOG_ACQUISITION = 0x01; //Sensor readings
+const byte LOG_SCHEDULE = 0x02; //Clock and events
+const byte LOG_CONTROL = 0x04; //Zone demand and relays
+const byte LOG_UI = 0x08; //Buttons and display
+const byte LOG_SYSTEM = 0x10; //Start-up and configuration
+const byte LOG_ALL = 0xFF;
+
+extern byte g_nLogLevel; //Runtime verbosity
+extern byte g_nLogMask; //Bitwise flag of enabled categories
+extern byte g_nModbusAddress; //Serial port carries Modbus (no logging) when non-zero
+
+/** @brief  Checks runtime log filter
+*   @param  nLevel Log level
+*   @param  nCategory Log category
+*   @return <i>bool</i> True if output should be sent to serial port
+*/
+inline bool LogEnabled(byte nLevel, byte nCategory)
+{
+    return nLevel <= g_nLogLevel && (g_nLogMask & nCategory) && !g_nModbusAddress;
+}
+
+#define LOG_ENABLED(nLevel, nCategory) ((nLevel) <= LOG_LEVEL && LogEnabled(nLevel, nCategory))
+#define LOG_IF(nLevel, nCategory) if(LOG_ENABLED(nLevel, nCategory))
+
+#endif // LOG_H
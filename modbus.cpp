@@ -0,0 +1,168 @@
+/** riban heating controller - Modbus RTU slave
+*   Shares the serial port with the text command interface. ModbusPoll replaces ReadSerial when a slave address is set.
+*/
+
+#include "modbus.h"
+
+const unsigned long MODBUS_T35 = 4011; //Microseconds of silence that ends a frame (3.5 x 11 bit characters at 9600 baud)
+
+byte g_bufferModbus[MODBUS_BUFFER_SIZE]; //Also holds text commands when serial port is not in Modbus mode
+byte g_nModbusLength; //Quantity of bytes received in current frame (saturates at 255)
+unsigned long g_lModbusLastByte; //micros() when last byte received
+
+static void ModbusProcess(byte nLength, bool bBroadcast);
+
+/** @brief  Receives and handles Modbus frames
+*   @param  nAddress This slave's address (1-247)
+*   @note   Call frequently from main loop. Frame is processed once the line has been silent for 3.5 characters.
+*/
+void ModbusPoll(byte nAddress)
+{
+    while(Serial.available())
+    {
+        byte nByte = Serial.read();
+        if(g_nModbusLength < MODBUS_BUFFER_SIZE)
+            g_bufferModbus[g_nModbusLength] = nByte;
+        if(g_nModbusLength < 0xFF)
+            ++g_nModbusLength;
+        g_lModbusLastByte = micros();
+    }
+    if(g_nModbusLength == 0 || micros() - g_lModbusLastByte < MODBUS_T35)
+        return;
+    byte nLength = g_nModbusLength;
+    g_nModbusLength = 0;
+    if(nLength > MODBUS_BUFFER_SIZE || nLength < 4)
+        return; //Overrun or runt frame
+    if(ModbusCrc(g_bufferModbus, nLength - 2) != (unsigned int)(g_bufferModbus[nLength - 2] | (g_bufferModbus[nLength - 1] << 8)))
+        return;
+    if(g_bufferModbus[0] != nAddress && g_bufferModbus[0] != 0)
+        return; //Not for us
+    ModbusProcess(nLength - 2, g_bufferModbus[0] == 0);
+}
+
+/** @brief  Handles a validated request and sends response
+*   @param  nLength Length of request excluding CRC
+*   @param  bBroadcast True if broadcast request (no response sent)
+*   @note   Multiple register writes are validated before any register is written
+*/
+static void ModbusProcess(byte nLength, bool bBroadcast)
+{
+    unsigned int nStart = (g_bufferModbus[2] << 8) | g_bufferModbus[3];
+    unsigned int nQuant = (g_bufferModbus[4] << 8) | g_bufferModbus[5]; //Value for function 06
+    byte nException = MODBUS_OK;
+    byte nReply = 0;
+    switch(g_bufferModbus[1])
+    {
+    case 3:
+        //Read holding registers
+        if(nLength != 6 || bBroadcast)
+            return;
+        if(nQuant < 1 || nQuant > MODBUS_MAX_READ)
+        {
+            nException = MODBUS_ILLEGAL_VALUE;
+            break;
+        }
+        for(byte i = 0; i < nQuant && !nException; ++i)
+        {
+            unsigned int nValue;
+            nException = ModbusReadRegister(nStart + i, &nValue);
+            g_bufferModbus[3 + i * 2] = nValue >> 8;
+            g_bufferModbus[4 + i * 2] = nValue & 0xFF;
+        }
+        g_bufferModbus[2] = nQuant * 2;
+        nReply = 3 + nQuant * 2;
+        break;
+    case 6:
+        //Write single register
+        if(nLength != 6)
+            return;
+        nException = ModbusWriteRegister(nStart, nQuant, true);
+        if(!nException)
+            nException = ModbusWriteRegister(nStart, nQuant, false);
+        nReply = 6; //Echo request
+        break;
+    case 16:
+        //Write multiple registers
+        if(nLength < 7 || nLength != 7 + g_bufferModbus[6])
+            return;
+        if(nQuant < 1 || nQuant > MODBUS_MAX_WRITE || g_bufferModbus[6] != nQuant * 2)
+        {
+            nException = MODBUS_ILLEGAL_VALUE;
+            break;
+        }
+        for(byte nPass = 0; nPass < 2 && !nException; ++nPass)
+        {
+            for(byte i = 0; i < nQuant && !nException; ++i)
+                nException = ModbusWriteRegister(nStart + i, (g_bufferModbus[7 + i * 2] << 8) | g_bufferModbus[8 + i * 2], nPass == 0);
+        }
+        nReply = 6; //Echo start and quantity
+        break;
+    default:
+        nException = MODBUS_ILLEGAL_FUNCTION;
+    }
+    if(bBroadcast)
+        return;
+    if(nException)
+    {
+        g_bufferModbus[1] |= 0x80;
+        g_bufferModbus[2] = nException;
+        nReply = 3;
+    }
+    unsigned int nCrc = ModbusCrc(g_bufferModbus, nReply);
+    g_bufferModbus[nReply++] = nCrc & 0xFF;
+    g_bufferModbus[nReply++] = nCrc >> 8;
+    Serial.write(g_bufferModbus, nReply);
+}
+
+/** @brief  Calculates Modbus CRC16
+*   @param  pData Pointer to data
+*   @param  nLength Quantity of bytes
+*   @return <i>unsigned int</i> CRC (transmitted low byte first)
+*/
+unsigned int ModbusCrc(const byte* pData, byte nLength)
+{
+    unsigned int nCrc = 0xFFFF;
+    while(nLength--)
+        nCrc = ModbusCrcByte(nCrc, *pData++);
+    return nCrc;
+}
+
+/** @brief  Adds a byte to Modbus CRC16
+*   @param  nCrc CRC of preceding bytes (0xFFFF before first byte)
+*   @param  nByte Byte to add
+*   @return <i>unsigned int</i> CRC including byte
+*   @note   Lets data that is not held in one buffer (e.g. EEPROM) be checked byte by byte
+*/
+unsigned int ModbusCrcByte(unsigned int nCrc, byte nByte)
+{
+    nCrc ^= nByte;
+    for(byte nBit = 0; nBit < 8; ++nBit)
+    {
+        if(nCrc & 1)
+            nCrc = (nCrc >> 1) ^ 0xA001;
+        else
+            nCrc >>= 1;
+    }
+    return nCrc;
+}
+
+/** @brief  Gets value a write request being handled writes to a register
+*   @param  nRegister Register address
+*   @param  pValue Pointer to value to populate
+*   @return <i>bool</i> True if request writes register
+*   @note   Only valid during ModbusWriteRegister. Lets application check registers that must change together.
+*/
+bool ModbusGetWriteValue(unsigned int nRegister, unsigned int* pValue)
+{
+    unsigned int nStart = (g_bufferModbus[2] << 8) | g_bufferModbus[3];
+    unsigned int nQuant = (g_bufferModbus[4] << 8) | g_bufferModbus[5];
+    byte nOffset;
+    if(g_bufferModbus[1] == 6 && nRegister == nStart)
+        nOffset = 4;
+    else if(g_bufferModbus[1] == 16 && nRegister >= nStart && nRegister - nStart < nQuant)
+        nOffset = 7 + (nRegister - nStart) * 2;
+    else
+        return false;
+    *pValue = (g_bufferModbus[nOffset] << 8) | g_bufferModbus[nOffset + 1];
+    return true;
+}
@@ -0,0 +1,41 @@
+/** riban heating controller - Modbus RTU slave
+*   Frames are delimited by 3.5 character silence on the serial port. Supports functions 03 (read holding registers),
+*   06 (write single register) and 16 (write multiple registers). Register map is provided by the application.
+*/
+#ifndef MODBUS_H
+#define MODBUS_H
+
+#include "Arduino.h"
+
+const byte MODBUS_OK = 0;
+const byte MODBUS_ILLEGAL_FUNCTION = 1;
+const byte MODBUS_ILLEGAL_ADDRESS = 2;
+const byte MODBUS_ILLEGAL_VALUE = 3;
+const byte MODBUS_BUFFER_SIZE = 64; //Largest frame handled
+const byte MODBUS_MAX_READ = (MODBUS_BUFFER_SIZE - 5) / 2; //Registers per read response (address, function, count, data, CRC)
+const byte MODBUS_MAX_WRITE = (MODBUS_BUFFER_SIZE - 9) / 2; //Registers per write request (address, function, start, quantity, count, data, CRC)
+
+extern byte g_bufferModbus[MODBUS_BUFFER_SIZE]; //Frame buffer - free for other use whilst serial port is not in Modbus mode
+
+void ModbusPoll(byte nAddress);
+unsigned int ModbusCrc(const byte* pData, byte nLength);
+unsigned int ModbusCrcByte(unsigned int nCrc, byte nByte);
+
+/** @brief  Reads a holding register - implemented by application
+*   @param  nRegister Register address
+*   @param  pValue Pointer to value to populate
+*   @return <i>byte</i> MODBUS_OK on success or exception code
+*/
+byte ModbusReadRegister(unsigned int nRegister, unsigned int* pValue);
+
+/** @brief  Writes a holding register - implemented by application
+*   @param  nRegister Register address
+*   @param  nValue Value to write
+*   @param  bTest True to validate address and value without writing
+*   @return <i>byte</i> MODBUS_OK on success or exception code
+*/
+byte ModbusWriteRegister(unsigned int nRegister, unsigned int nValue, bool bTest);
+
+bool ModbusGetWriteValue(unsigned int nRegister, unsigned int* pValue);
+
+#endif // MODBUS_H
@@ -0,0 +1,47 @@
+/** riban heating controller - logic analyser timing probes
+*   With FEATURE_PROBE enabled each loop phase boundary (see diag.h) toggles PROBE_PIN and each sensor reading toggles
+*   PROBE_SENSOR_PIN at start and end. A toggle is a single write to the port input register so probes add no measurable
+*   time and no serial traffic. With one pin the phases follow in loop order: clock, schedule, sensor, control, serial,
+*   lcd, idle (clock to control only at minute boundary).
+*   A0 is the only spare GPIO with LCD fitted. Headless builds may set PROBE_SENSOR_PIN to a free LCD pin (e.g. 2).
+*/
+#ifndef PROBE_H
+#define PROBE_H
+
+#include "feature.h"
+#include "fastio.h"
+
+#ifndef PROBE_PIN
+#define PROBE_PIN A0 //Loop phase probe
+#endif // PROBE_PIN
+
+#ifndef PROBE_SENSOR_PIN
+#define PROBE_SENSOR_PIN PROBE_PIN //Sensor reading probe
+#endif // PROBE_SENSOR_PIN
+
+#if FEATURE_PROBE
+/** @brief  Configures probe pins as outputs */
+inline void ProbeBegin()
+{
+    FastPin<PROBE_PIN>::Direction() |= FastPin<PROBE_PIN>::MASK;
+    FastPin<PROBE_SENSOR_PIN>::Direction() |= FastPin<PROBE_SENSOR_PIN>::MASK;
+}
+
+/** @brief  Marks a loop phase boundary */
+inline void ProbeToggle()
+{
+    FastPin<PROBE_PIN>::Toggle();
+}
+
+/** @brief  Marks start or end of a sensor reading */
+inline void ProbeSensor()
+{
+    FastPin<PROBE_SENSOR_PIN>::Toggle();
+}
+#else
+inline void ProbeBegin() {}
+inline void ProbeToggle() {}
+inline void ProbeSensor() {}
+#endif // FEATURE_PROBE
+
+#endif // PROBE_H
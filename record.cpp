@@ -0,0 +1,362 @@
+/** riban heating controller - record field descriptors */
+
+#include "record.h"
+#include "format.h"
+#include "scratch.h"
+#include <EEPROM.h>
+
+const char DAY_NAMES[] PROGMEM = "SunMonTueWedThuFriSat";
+
+/** @brief  Gets a field descriptor from flash
+*   @param  pField Pointer to descriptor in flash
+*   @param  pCopy Pointer to descriptor to populate
+*/
+static void GetField(const field* pField, field* pCopy)
+{
+    memcpy_P(pCopy, pField, sizeof(field));
+}
+
+/** @brief  Gets bytes occupied by a field in a record image
+*   @param  pField Pointer to descriptor (in RAM)
+*   @return <i>byte</i> Width in bytes
+*/
+static byte FieldWidth(const field* pField)
+{
+    switch(pField->nType)
+    {
+    case FIELD_INT:
+    case FIELD_UINT:
+    case FIELD_TIME:
+        return 2;
+    case FIELD_HEX:
+    case FIELD_TEXT:
+        return pField->nSize;
+    default:
+        return 1;
+    }
+}
+
+/** @brief  Encodes persisted fields of a record to a binary image
+*   @param  pImage Pointer to image buffer (at least the record's EEPROM size)
+*   @param  pFields Pointer to field descriptors in flash
+*   @param  nFields Quantity of fields
+*   @param  pRecord Pointer to record structure
+*/
+void EncodeRecord(byte* pImage, const field* pFields, byte nFields, const void* pRecord)
+{
+    for(byte nField = 0; nField < nFields; ++nField)
+    {
+        field f;
+        GetField(&pFields[nField], &f);
+        if(f.nEeprom == FIELD_RUNTIME)
+            continue;
+        const byte* pMember = (const byte*)pRecord + f.nOffset;
+        byte* pOut = pImage + f.nEeprom;
+        switch(f.nType)
+        {
+        case FIELD_BOOL:
+            *pOut = *(const bool*)pMember ? 1 : 0;
+            break;
+        case FIELD_INT:
+        case FIELD_UINT:
+        case FIELD_TIME:
+            pOut[0] = *(const unsigned int*)pMember >> 8;
+            pOut[1] = *(const unsigned int*)pMember & 0xFF;
+            break;
+        default:
+            memcpy(pOut, pMember, FieldWidth(&f));
+        }
+    }
+}
+
+/** @brief  Decodes persisted fields of a record from a binary image
+*   @param  pImage Pointer to image
+*   @param  pFields Pointer to field descriptors in flash
+*   @param  nFields Quantity of fields
+*   @param  pRecord Pointer to record structure to populate. Runtime fields are unchanged.
+*/
+void DecodeRecord(const byte* pImage, const field* pFields, byte nFields, void* pRecord)
+{
+    for(byte nField = 0; nField < nFields; ++nField)
+    {
+        field f;
+        GetField(&pFields[nField], &f);
+        if(f.nEeprom == FIELD_RUNTIME)
+            continue;
+        byte* pMember = (byte*)pRecord + f.nOffset;
+        const byte* pIn = pImage + f.nEeprom;
+        switch(f.nType)
+        {
+        case FIELD_BOOL:
+            *(bool*)pMember = (*pIn == 1);
+            break;
+        case FIELD_INT:
+        case FIELD_UINT:
+        case FIELD_TIME:
+            *(unsigned int*)pMember = (pIn[0] << 8) | pIn[1];
+            break;
+        default:
+            memcpy(pMember, pIn, FieldWidth(&f));
+        }
+    }
+}
+
+/** @brief  Loads a record from EEPROM
+*   @param  nAddress EEPROM address of record
+*   @param  nSize Quantity of bytes in record image (maximum RECORD_MAX_SIZE)
+*   @param  pFields Pointer to field descriptors in flash
+*   @param  nFields Quantity of fields
+*   @param  pRecord Pointer to record structure to populate
+*   @return <i>bool</i> True on success. False if scratch lease failed and record is unchanged.
+*/
+bool LoadRecord(unsigned int nAddress, byte nSize, const field* pFields, byte nFields, void* pRecord)
+{
+    Scratch<RECORD_MAX_SIZE> scratchImage;
+    if(!scratchImage.Valid())
+        return false;
+    byte* pImage = scratchImage.Bytes();
+    for(byte i = 0; i < nSize; ++i)
+        pImage[i] = EEPROM.read(nAddress + i);
+    DecodeRecord(pImage, pFields, nFields, pRecord);
+    return true;
+}
+
+/** @brief  Saves a record to EEPROM
+*   @param  nAddress EEPROM address of record
+*   @param  nSize Quantity of bytes in record image (maximum RECORD_MAX_SIZE)
+*   @param  pFields Pointer to field descriptors in flash
+*   @param  nFields Quantity of fields
+*   @param  pRecord Pointer to record structure
+*   @param  nMask Bitwise flag of fields to save. Bit 0 = first field.
+*   @return <i>bool</i> True if any byte was written. False if unchanged or scratch lease failed.
+*   @note   Only bytes that differ from EEPROM are written to limit wear
+*/
+bool SaveRecord(unsigned int nAddress, byte nSize, const field* pFields, byte nFields, const void* pRecord, unsigned int nMask)
+{
+    Scratch<RECORD_MAX_SIZE> scratchImage;
+    if(!scratchImage.Valid())
+        return false;
+    byte* pImage = scratchImage.Bytes();
+    EncodeRecord(pImage, pFields, nFields, pRecord);
+    bool bWritten = false;
+    for(byte nField = 0; nField < nFields; ++nField)
+    {
+        field f;
+        GetField(&pFields[nField], &f);
+        if(f.nEeprom == FIELD_RUNTIME || !(nMask & (1 << nField)))
+            continue;
+        for(byte i = f.nEeprom; i < f.nEeprom + FieldWidth(&f) && i < nSize; ++i)
+        {
+            if(EEPROM.read(nAddress + i) == pImage[i])
+                continue;
+            EEPROM.write(nAddress + i, pImage[i]);
+            bWritten = true;
+        }
+    }
+    return bWritten;
+}
+
+/** @brief  Gets value of a hexadecimal character
+*   @param  cChar Character (0-9, A-F, a-f)
+*   @return <i>byte</i> Value or 0xFF if not hexadecimal
+*/
+static byte HexValue(char cChar)
+{
+    if(cChar >= '0' && cChar <= '9')
+        return cChar - '0';
+    if(cChar >= 'A' && cChar <= 'F')
+        return cChar - 'A' + 10;
+    if(cChar >= 'a' && cChar <= 'f')
+        return cChar - 'a' + 10;
+    return 0xFF;
+}
+
+/** @brief  Parses a decimal value
+*   @param  pText Pointer to first character
+*   @param  pEnd Pointer to end of token
+*   @param  nDecimals Fixed point decimal places of field
+*   @param  pValue Pointer to value to populate
+*   @return <i>bool</i> True if valid
+*   @note   Without a decimal point the value is taken as already scaled (e.g. 205 = 20.5 for one decimal place)
+*/
+static bool ParseNumber(const char* pText, const char* pEnd, byte nDecimals, long* pValue)
+{
+    bool bNegative = false;
+    if(pText < pEnd && (*pText == '+' || *pText == '-'))
+        bNegative = (*pText++ == '-');
+    long lValue = 0;
+    char nPlaces = -1; //Decimal places seen. -1 before decimal point
+    bool bDigit = false;
+    for(; pText < pEnd; ++pText)
+    {
+        if(*pText == '.' && nPlaces < 0)
+        {
+            nPlaces = 0;
+            continue;
+        }
+        if(*pText < '0' || *pText > '9')
+            return false;
+        if(nPlaces >= (char)nDecimals)
+            continue; //Ignore excess precision
+        lValue = lValue * 10 + *pText - '0';
+        if(nPlaces >= 0)
+            ++nPlaces;
+        bDigit = true;
+    }
+    if(!bDigit)
+        return false;
+    for(; nPlaces >= 0 && nPlaces < (char)nDecimals; ++nPlaces)
+        lValue *= 10;
+    *pValue = bNegative ? -lValue : lValue;
+    return true;
+}
+
+/** @brief  Parses persisted fields of a record from text
+*   @param  pText Pointer to text. Fields are separated by spaces in table order. Text field takes rest of line.
+*   @param  nLength Quantity of characters in text
+*   @param  pFields Pointer to field descriptors in flash
+*   @param  nFields Quantity of fields
+*   @param  pRecord Pointer to record structure to populate
+*   @return <i>byte</i> Quantity of fields parsed. Parsing stops at first missing or invalid field.
+*/
+byte ParseRecord(const char* pText, byte nLength, const field* pFields, byte nFields, void* pRecord)
+{
+    const char* pEnd = pText + nLength;
+    byte nParsed = 0;
+    for(byte nField = 0; nField < nFields; ++nField)
+    {
+        field f;
+        GetField(&pFields[nField], &f);
+        if(f.nEeprom == FIELD_RUNTIME)
+            continue;
+        while(pText < pEnd && *pText == ' ')
+            ++pText;
+        if(pText >= pEnd)
+            break;
+        const char* pToken = pText;
+        while(pText < pEnd && *pText != ' ')
+            ++pText;
+        byte* pMember = (byte*)pRecord + f.nOffset;
+        long lValue;
+        switch(f.nType)
+        {
+        case FIELD_BYTE:
+        case FIELD_INT:
+        case FIELD_UINT:
+            if(!ParseNumber(pToken, pText, f.nDecimals, &lValue))
+                return nParsed;
+            if(f.nType == FIELD_BYTE)
+            {
+                if(lValue < 0 || lValue > 0xFF)
+                    return nParsed;
+                *pMember = lValue;
+            }
+            else if(f.nType == FIELD_INT)
+                *(int*)pMember = lValue;
+            else
+                *(unsigned int*)pMember = lValue;
+            break;
+        case FIELD_BOOL:
+            *(bool*)pMember = (*pToken != '0');
+            break;
+        case FIELD_HEX:
+        case FIELD_DAYS:
+        {
+            byte nBytes = (f.nType == FIELD_HEX) ? f.nSize : 1;
+            if(pText - pToken != nBytes * 2)
+                return nParsed;
+            for(byte i = 0; i < nBytes; ++i)
+            {
+                byte nHigh = HexValue(pToken[i * 2]);
+                byte nLow = HexValue(pToken[i * 2 + 1]);
+                if(nHigh > 0x0F || nLow > 0x0F)
+                    return nParsed;
+                pMember[i] = (nHigh << 4) | nLow;
+            }
+            break;
+        }
+        case FIELD_TIME:
+        {
+            const char* pColon = pToken;
+            while(pColon < pText && *pColon != ':')
+                ++pColon;
+            long lHour, lMinute;
+            if(!ParseNumber(pToken, pColon, 0, &lHour) || !ParseNumber(pColon + 1, pText, 0, &lMinute) || lHour > 23 || lMinute > 59)
+                return nParsed;
+            *(unsigned int*)pMember = lHour * 60 + lMinute;
+            break;
+        }
+        case FIELD_TEXT:
+            pText = pEnd; //Text is rest of line
+            for(byte i = 0; i < f.nSize; ++i)
+                pMember[i] = (pToken + i < pEnd) ? pToken[i] : ' ';
+            break;
+        }
+        ++nParsed;
+    }
+    return nParsed;
+}
+
+/** @brief  Prints all fields of a record to serial port as label=value pairs
+*   @param  pFields Pointer to field descriptors in flash
+*   @param  nFields Quantity of fields
+*   @param  pRecord Pointer to record structure
+*   @note   Does not end line so caller may append. Record is formatted in one buffer and written with one serial write.
+*/
+void PrintRecord(const field* pFields, byte nFields, const void* pRecord)
+{
+    Scratch<RECORD_LINE_SIZE> scratchLine;
+    if(!scratchLine.Valid())
+        return;
+    char* sLine = scratchLine.Chars();
+    char* pLine = sLine;
+    for(byte nField = 0; nField < nFields; ++nField)
+    {
+        field f;
+        GetField(&pFields[nField], &f);
+        const byte* pMember = (const byte*)pRecord + f.nOffset;
+        pLine = FormatString(pLine, f.sLabel, sizeof(f.sLabel));
+        *pLine++ = '=';
+        switch(f.nType)
+        {
+        case FIELD_BYTE:
+            pLine = f.nDecimals ? FormatFixed(pLine, *pMember, f.nDecimals) : FormatUnsigned(pLine, *pMember);
+            break;
+        case FIELD_BOOL:
+            pLine = FormatUnsigned(pLine, *(const bool*)pMember ? 1 : 0);
+            break;
+        case FIELD_INT:
+            pLine = f.nDecimals ? FormatFixed(pLine, *(const int*)pMember, f.nDecimals) : FormatSigned(pLine, *(const int*)pMember);
+            break;
+        case FIELD_UINT:
+            pLine = FormatUnsigned(pLine, *(const unsigned int*)pMember);
+            break;
+        case FIELD_HEX:
+            for(byte i = 0; i < f.nSize; ++i)
+                pLine = FormatHex(pLine, pMember[i]);
+            break;
+        case FIELD_DAYS:
+            for(byte nDay = 0; nDay < 7; ++nDay)
+            {
+                if(!(*pMember & (1 << nDay)))
+                    continue;
+                if(pLine[-1] != '=')
+                    *pLine++ = ',';
+                memcpy_P(pLine, DAY_NAMES + nDay * 3, 3);
+                pLine += 3;
+            }
+            break;
+        case FIELD_TIME:
+            pLine = FormatUnsigned(pLine, *(const unsigned int*)pMember / 60);
+            *pLine++ = ':';
+            pLine = FormatUnsigned(pLine, *(const unsigned int*)pMember % 60, 2, '0');
+            break;
+        case FIELD_TEXT:
+            pLine = FormatString(pLine, (const char*)pMember, f.nSize);
+            break;
+        }
+        *pLine++ = ' ';
+    }
+    *pLine = 0;
+    Serial.print(sLine);
+}
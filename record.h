@@ -0,0 +1,46 @@
+/** riban heating controller - record field descriptors
+*   Each record type (sensor, zone, event) is described once by a table of fields held in flash. Generic functions use
+*   the table to load and save EEPROM, encode and decode the binary record image, parse text commands and print
+*   listings, so each operation has one code path for all record types and the layouts cannot drift apart.
+*   Fields with an EEPROM offset are persisted and parsed in table order. FIELD_RUNTIME fields are printed only.
+*   Binary images are big-endian at each field's EEPROM offset so the image is the EEPROM record.
+*/
+#ifndef RECORD_H
+#define RECORD_H
+
+#include "Arduino.h"
+#include <stddef.h>
+
+const byte FIELD_BYTE = 0; //Unsigned char. Decimal, optionally fixed point
+const byte FIELD_BOOL = 1; //bool. 1 or 0
+const byte FIELD_INT = 2; //int. Signed decimal, optionally fixed point
+const byte FIELD_UINT = 3; //unsigned int. Decimal
+const byte FIELD_HEX = 4; //Array of nSize bytes. Hexadecimal
+const byte FIELD_DAYS = 5; //Bitwise flag of day of week, LSB = Sunday. Parsed as hexadecimal, printed as day names
+const byte FIELD_TIME = 6; //unsigned int minutes since 00:00. h:mm
+const byte FIELD_TEXT = 7; //Array of nSize chars, space padded. Parses to end of line
+const byte FIELD_RUNTIME = 0xFF; //EEPROM offset of field that is not persisted
+const byte RECORD_MAX_SIZE = 20; //Largest record image (bytes)
+const byte RECORD_LINE_SIZE = 84; //Longest printed record: sensor with 16 digit UID and all counters 65535 (83 chars + null)
+
+struct field
+{
+    char sLabel[9]; //Name printed before value
+    byte nType; //FIELD_ type
+    byte nSize; //Quantity of bytes or characters of FIELD_HEX and FIELD_TEXT
+    byte nDecimals; //Decimal places of fixed point FIELD_BYTE and FIELD_INT (0 - 2)
+    byte nOffset; //Offset of member within record structure
+    byte nEeprom; //Offset within EEPROM record or FIELD_RUNTIME
+};
+
+/** Declares a field descriptor of member MEMBER of structure STRUCT */
+#define FIELD(LABEL, TYPE, SIZE, DECIMALS, STRUCT, MEMBER, EEPROM) {LABEL, TYPE, SIZE, DECIMALS, offsetof(STRUCT, MEMBER), EEPROM}
+
+void EncodeRecord(byte* pImage, const field* pFields, byte nFields, const void* pRecord);
+void DecodeRecord(const byte* pImage, const field* pFields, byte nFields, void* pRecord);
+bool LoadRecord(unsigned int nAddress, byte nSize, const field* pFields, byte nFields, void* pRecord);
+bool SaveRecord(unsigned int nAddress, byte nSize, const field* pFields, byte nFields, const void* pRecord, unsigned int nMask = 0xFFFF);
+byte ParseRecord(const char* pText, byte nLength, const field* pFields, byte nFields, void* pRecord);
+void PrintRecord(const field* pFields, byte nFields, const void* pRecord);
+
+#endif // RECORD_H
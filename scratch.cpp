@@ -0,0 +1,45 @@
+/** riban heating controller - static scratch arena */
+
+#include "scratch.h"
+
+byte g_scratch[SCRATCH_SIZE];
+byte g_nScratchTop = 0;
+byte g_nScratchPeak = 0; //Most bytes leased at once
+unsigned int g_nScratchOverflows = 0; //Quantity of leases that failed as they did not fit above outer leases
+
+extern int __heap_start;
+extern int* __brkval;
+
+/** @brief  Takes bytes from top of arena
+*   @param  nSize Quantity of bytes
+*   @return <i>byte</i> Offset of leased bytes within arena. SCRATCH_FAILED if they do not fit above outer leases.
+*   @note   Called by Scratch constructor. Lease is released by restoring g_nScratchTop.
+*/
+byte ScratchLease(byte nSize)
+{
+    byte nOffset = g_nScratchTop;
+    if(nSize > SCRATCH_SIZE - nOffset)
+    {
+        ++g_nScratchOverflows;
+        return SCRATCH_FAILED;
+    }
+    g_nScratchTop += nSize;
+    if(g_nScratchTop > g_nScratchPeak)
+        g_nScratchPeak = g_nScratchTop;
+    return nOffset;
+}
+
+/** @brief  Prints arena peak use, overflows and free SRAM between heap and stack to serial port */
+void ScratchShow()
+{
+    int nStack;
+    int nFree = (char*)&nStack - (__brkval ? (char*)__brkval : (char*)&__heap_start);
+    Serial.print(F("Scratch peak="));
+    Serial.print(g_nScratchPeak);
+    Serial.print('/');
+    Serial.print(SCRATCH_SIZE);
+    Serial.print(F(" overflows="));
+    Serial.print(g_nScratchOverflows);
+    Serial.print(F(" free="));
+    Serial.println(nFree);
+}
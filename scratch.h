@@ -0,0 +1,69 @@
+/** riban heating controller - static scratch arena
+*   Transient buffers (listing lines, scratchpad reads, search addresses) lease memory from one static arena instead of
+*   each taking its own storage, so buffers that are never live together share SRAM and the total is known at link time.
+*   Leases are scoped: a Scratch object takes its bytes on construction and returns them on destruction, so leases nest
+*   like the stack frames that hold them. Lease size is a template parameter and fails to compile if it exceeds the arena.
+*   A nested lease that does not fit above its outer leases fails rather than overlapping them: Valid() returns false and
+*   the holder must abandon its work (a listing line is not printed, a sensor read reports failure). Failures are counted
+*   and ScratchShow reports them with peak use so SCRATCH_SIZE can be tuned.
+*/
+#ifndef SCRATCH_H
+#define SCRATCH_H
+
+#include "Arduino.h"
+
+const byte SCRATCH_SIZE = 96; //Bytes in arena. Largest leases are the configuration hash line and a printed sensor record (84)
+
+const byte SCRATCH_FAILED = 0xFF; //Offset of a lease that did not fit
+typedef char ArenaBelowFailed[(SCRATCH_SIZE < SCRATCH_FAILED) ? 1 : -1];
+
+extern byte g_scratch[SCRATCH_SIZE]; //Arena
+extern byte g_nScratchTop; //Bytes leased
+
+byte ScratchLease(byte nSize);
+void ScratchShow();
+
+template<byte SIZE> class Scratch
+{
+    typedef char FitsArena[(SIZE <= SCRATCH_SIZE) ? 1 : -1]; //Fails to compile if lease is larger than arena
+
+public:
+    /** @brief  Leases SIZE bytes from arena */
+    Scratch() : nBase(g_nScratchTop), nOffset(ScratchLease(SIZE))
+    {
+    }
+
+    /** @brief  Returns lease (and any nested within it) to arena */
+    ~Scratch()
+    {
+        g_nScratchTop = nBase;
+    }
+
+    /** @brief  Checks lease succeeded
+    *   @return <i>bool</i> True if leased memory may be used. False if it did not fit above outer leases.
+    */
+    bool Valid()
+    {
+        return nOffset != SCRATCH_FAILED;
+    }
+
+    /** @brief  Get leased memory as characters */
+    char* Chars()
+    {
+        return (char*)(g_scratch + nOffset);
+    }
+
+    /** @brief  Get leased memory as bytes */
+    byte* Bytes()
+    {
+        return g_scratch + nOffset;
+    }
+
+private:
+    Scratch(const Scratch&); //Leases may not be copied
+    Scratch& operator=(const Scratch&);
+    byte nBase; //Arena top before lease
+    byte nOffset; //Offset of leased memory within arena. SCRATCH_FAILED if lease did not fit.
+};
+
+#endif // SCRATCH_H
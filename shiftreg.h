@@ -0,0 +1,62 @@
+/** riban heating controller - 74HC595 shift register output expander
+*   Drives a chain of daisy-chained 74HC595 shift registers from three pins. Bit 0 of the frame appears on Q0 of the
+*   register nearest the MCU. A frame is only clocked out when it differs from the outputs already latched.
+*/
+#ifndef SHIFTREG_H
+#define SHIFTREG_H
+
+#include "fastio.h"
+
+template<byte PIN_DATA, byte PIN_CLOCK, byte PIN_LATCH, byte REGISTERS> class ShiftRegister
+{
+    typedef char ChainFitsFrame[(REGISTERS > 0 && REGISTERS <= sizeof(unsigned int)) ? 1 : -1];
+
+public:
+    /** @brief  Configures pins and clears all outputs */
+    void Begin()
+    {
+        FastPin<PIN_DATA>::Direction() |= FastPin<PIN_DATA>::MASK;
+        FastPin<PIN_CLOCK>::Direction() |= FastPin<PIN_CLOCK>::MASK;
+        FastPin<PIN_LATCH>::Direction() |= FastPin<PIN_LATCH>::MASK;
+        bValid = false;
+        Write(0);
+    }
+
+    /** @brief  Sets outputs
+    *   @param  nBits Bitwise flag of outputs. Bit 0 = first output of first register.
+    *   @return <i>bool</i> True if a new frame was clocked out
+    */
+    bool Write(unsigned int nBits)
+    {
+        if(bValid && nBits == nFrame)
+            return false;
+        for(byte nBit = REGISTERS * 8; nBit > 0; --nBit)
+        {
+            FastPin<PIN_DATA>::Set(nBits & (1U << (nBit - 1)));
+            FastPin<PIN_CLOCK>::Set(true);
+            FastPin<PIN_CLOCK>::Set(false);
+        }
+        FastPin<PIN_LATCH>::Set(true); //Transfer shift register to outputs
+        FastPin<PIN_LATCH>::Set(false);
+        nFrame = nBits;
+        bValid = true;
+        ++nFrames;
+        return true;
+    }
+
+    /** @brief  Get current outputs
+    *   @return <i>unsigned int</i> Bitwise flag of outputs
+    */
+    unsigned int Read()
+    {
+        return nFrame;
+    }
+
+    unsigned int nFrames; //Quantity of frames clocked out
+
+private:
+    unsigned int nFrame; //Frame latched on outputs
+    bool bValid; //True once a frame has been latched
+};
+
+#endif // SHIFTREG_H
@@ -0,0 +1,377 @@
+/** riban heating controller - fleet simulator
+*   Host tool to sweep control parameters across a fleet of simulated houses before changing controller defaults.
+*   Each job runs one controller instance (the controller's own filter, zone control and demand scheduling code) against its own
+*   thermal model and virtual clock for a number of weeks.
+*   Jobs are spread across all CPU cores by a work-stealing pool and results are aggregated per parameter set.
+*
+*   Swept parameters:
+*       Space zone hysteresis (C/10)
+*       Control period - interval between relay updates (s)
+*       Sampling interval - interval between sensor readings (s)
+*       Reading filter shift
+*       Demand scheduling - off, hot water priority, or hot water priority and demand batching
+*
+*   Reported per parameter set (mean of all houses and weeks):
+*       Comfort - percentage of occupied time that space temperature is within COMFORT_BAND of set-point
+*       Burner on-time (hours per week)
+*       Burner cycles (starts per week)
+*       Relay transitions per week and, for scheduled sets, percentage saved against the same set unscheduled (negative = more)
+*
+*   Usage: fleetsim [-h houses] [-w weeks] [-t threads] [-s seed] [-c]
+*       -c prints comma separated values instead of a table
+*/
+
+#include "control.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+const unsigned int WEEK = 7 * 24 * 3600; //Seconds in a week
+const unsigned int STEP = 10; //Thermal model integration step (s)
+const double COMFORT_BAND = 0.5; //Maximum deviation from set-point counted as comfortable (C)
+const int SPACE_SETPOINT_DAY = 210; //Occupied space set-point (C/10)
+const int SPACE_SETPOINT_NIGHT = 160; //Unoccupied space set-point (C/10)
+const unsigned int SPACE_DAY_START = 6 * 3600 + 1800; //Start of occupied period (s since 00:00)
+const unsigned int SPACE_DAY_END = 22 * 3600 + 1800; //End of occupied period (s since 00:00)
+const int WATER_SETPOINT = 550; //Hot water cylinder set-point (C/10)
+const byte WATER_HYST = 50; //Hot water cylinder hysteresis (C/10)
+const double SENSOR_NOISE = 0.05; //Standard deviation of sensor noise (C)
+const double SENSOR_GLITCH = 0.001; //Probability of a reading being a spike
+const byte ZONE_WATER = 0;
+const byte ZONE_SPACE = 1;
+const byte PRIORITY_HOLD = 30; //Maximum control periods hot water holds off space heating
+
+const byte SWEEP_HYST[] = {2, 5, 10, 15};
+const unsigned int SWEEP_CONTROL[] = {60, 120, 300};
+const unsigned int SWEEP_SAMPLE[] = {10, 30, 60};
+const byte SWEEP_FILTER[] = {0, 2, 4};
+const byte SCHEDULE_OFF = 0; //No priority or batching
+const byte SCHEDULE_PRIORITY = 1; //Hot water priority
+const byte SCHEDULE_BATCH = 2; //Hot water priority and demand batching
+const byte SWEEP_SCHEDULE[] = {SCHEDULE_OFF, SCHEDULE_PRIORITY, SCHEDULE_BATCH}; //Must be last with SCHEDULE_OFF first for transitions saved comparison
+const char* SCHEDULE_NAME[] = {"off", "pri", "batch"};
+
+template<typename T, size_t N> size_t Count(const T (&)[N]) { return N; }
+
+struct house
+{
+    double dLoss; //Rate of heat loss from space to outdoors (1/h)
+    double dCoupling; //Rate of heat transfer between emitters and space (1/h)
+    double dMassRatio; //Thermal mass of space relative to emitters
+    double dBoilerPower; //Rate of emitter temperature rise with boiler and pump on (C/h)
+    double dOutdoorMean; //Mean outdoor temperature (C)
+    double dOutdoorSwing; //Amplitude of daily outdoor temperature variation (C)
+    double dCylinderLoss; //Rate of heat loss from hot water cylinder (1/h)
+    double dCylinderPower; //Rate of cylinder temperature rise with boiler on (C/h)
+    double dDraw; //Temperature drop of cylinder for each hot water draw (C)
+};
+
+struct parameters
+{
+    byte nHyst; //Space zone hysteresis (C/10)
+    unsigned int nControlPeriod; //Interval between relay updates (s)
+    unsigned int nSamplePeriod; //Interval between sensor readings (s)
+    byte nFilterShift; //Reading filter shift
+    byte nSchedule; //SCHEDULE_x demand scheduling
+};
+
+struct result
+{
+    unsigned long lComfort; //Seconds of occupied time within comfort band
+    unsigned long lOccupied; //Seconds of occupied time
+    unsigned long lBurner; //Seconds of burner on-time
+    unsigned long lCycles; //Quantity of burner starts
+    unsigned long lTransitions; //Quantity of relay transitions
+};
+
+/** @brief  Runs jobs across a fixed quantity of threads
+*   @note   Each thread has its own queue of jobs which it takes from the back. When empty it steals from the front
+*           of other threads' queues so that threads finishing early take work from those still busy.
+*/
+class WorkStealingPool
+{
+    public:
+        WorkStealingPool(unsigned int nThreads) : m_queues(nThreads) {}
+
+        /** @brief  Runs a function for each job index, returning when all jobs complete
+        *   @param  lJobs Quantity of jobs
+        *   @param  fnJob Function called with each job index
+        */
+        void Run(size_t lJobs, std::function<void(size_t)> fnJob)
+        {
+            for(size_t lJob = 0; lJob < lJobs; ++lJob)
+                m_queues[lJob % m_queues.size()].jobs.push_back(lJob);
+            std::vector<std::thread> vThreads;
+            for(unsigned int nThread = 0; nThread < m_queues.size(); ++nThread)
+                vThreads.push_back(std::thread(&WorkStealingPool::Worker, this, nThread, fnJob));
+            for(size_t nThread = 0; nThread < vThreads.size(); ++nThread)
+                vThreads[nThread].join();
+        }
+
+        /** @brief  Gets quantity of jobs that were stolen from another thread's queue */
+        unsigned long GetSteals() { return m_lSteals; }
+
+    private:
+        struct queue
+        {
+            std::mutex mutex;
+            std::deque<size_t> jobs;
+        };
+
+        void Worker(unsigned int nThread, std::function<void(size_t)> fnJob)
+        {
+            size_t lJob;
+            while(Take(nThread, lJob))
+                fnJob(lJob);
+        }
+
+        bool Take(unsigned int nThread, size_t& lJob)
+        {
+            {
+                queue& own = m_queues[nThread];
+                std::lock_guard<std::mutex> lock(own.mutex);
+                if(!own.jobs.empty())
+                {
+                    lJob = own.jobs.back();
+                    own.jobs.pop_back();
+                    return true;
+                }
+            }
+            //Jobs do not create jobs so once every queue is empty this thread is finished
+            for(size_t nOffset = 1; nOffset < m_queues.size(); ++nOffset)
+            {
+                queue& victim = m_queues[(nThread + nOffset) % m_queues.size()];
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if(!victim.jobs.empty())
+                {
+                    lJob = victim.jobs.front();
+                    victim.jobs.pop_front();
+                    ++m_lSteals;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        std::vector<queue> m_queues;
+        std::atomic<unsigned long> m_lSteals{0};
+};
+
+/** @brief  Creates a house profile
+*   @param  nHouse Index of house
+*   @param  lSeed Fleet seed
+*   @return <i>house</i> Profile which is the same for every parameter set
+*/
+house MakeHouse(unsigned int nHouse, unsigned long lSeed)
+{
+    std::mt19937 rng(lSeed * 7919 + nHouse);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    house h;
+    h.dLoss = 0.03 + 0.07 * uniform(rng); //Well insulated to draughty
+    h.dCoupling = 0.5 + 1.5 * uniform(rng); //Underfloor to fan convector
+    h.dMassRatio = 3.0 + 7.0 * uniform(rng);
+    h.dBoilerPower = 20.0 + 40.0 * uniform(rng);
+    h.dOutdoorMean = -5.0 + 15.0 * uniform(rng);
+    h.dOutdoorSwing = 2.0 + 6.0 * uniform(rng);
+    h.dCylinderLoss = 0.01 + 0.02 * uniform(rng);
+    h.dCylinderPower = 15.0 + 25.0 * uniform(rng);
+    h.dDraw = 5.0 + 15.0 * uniform(rng);
+    return h;
+}
+
+/** @brief  Simulates a sensor reading as the controller would receive it
+*   @param  dTemperature Actual temperature (C)
+*   @param  rng Random number generator of job
+*   @return <i>int</i> Reading (C/100) at DS18B20 12-bit resolution
+*/
+int ReadSensor(double dTemperature, std::mt19937& rng)
+{
+    std::normal_distribution<double> noise(0.0, SENSOR_NOISE);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    double dValue = dTemperature + noise(rng);
+    if(uniform(rng) < SENSOR_GLITCH)
+        dValue += (uniform(rng) < 0.5) ? -5.0 : 5.0;
+    int nRaw = (int)std::floor(dValue * 16); //1/16 C
+    return nRaw * 6 + nRaw / 4; //Same conversion as controller
+}
+
+/** @brief  Simulates one house with one parameter set
+*   @param  h House profile
+*   @param  p Control parameters
+*   @param  nWeeks Quantity of weeks to simulate
+*   @param  lSeed Seed for sensor noise
+*   @return <i>result</i> Comfort and burner metrics
+*/
+result Simulate(const house& h, const parameters& p, unsigned int nWeeks, unsigned long lSeed)
+{
+    std::mt19937 rng(lSeed);
+    result res = {0, 0, 0, 0, 0};
+    sensor sensors[2];
+    zone zones[2];
+    memset(sensors, 0, sizeof(sensors));
+    memset(zones, 0, sizeof(zones));
+    sensors[ZONE_WATER].nZone = ZONE_WATER;
+    sensors[ZONE_SPACE].nZone = ZONE_SPACE;
+    zones[ZONE_WATER].nSetpoint = WATER_SETPOINT;
+    zones[ZONE_WATER].nHyst = WATER_HYST;
+    zones[ZONE_SPACE].nHyst = p.nHyst;
+    zones[ZONE_SPACE].bSpace = true;
+    scheduler sched;
+    memset(&sched, 0, sizeof(sched));
+    sched.nPriority = 1 << ZONE_WATER;
+    sched.nMaxHold = (p.nSchedule != SCHEDULE_OFF) ? PRIORITY_HOLD : 0;
+    sched.bBatch = (p.nSchedule == SCHEDULE_BATCH);
+
+    double dSpace = 18.0;
+    double dEmitter = 18.0;
+    double dWater = 50.0;
+    const double dStep = STEP / 3600.0; //Integration step (h)
+    for(unsigned long lTime = 0; lTime < (unsigned long)nWeeks * WEEK; lTime += STEP)
+    {
+        unsigned int nTimeOfDay = lTime % (24 * 3600);
+        bool bOccupied = (nTimeOfDay >= SPACE_DAY_START && nTimeOfDay < SPACE_DAY_END);
+        zones[ZONE_SPACE].nSetpoint = bOccupied ? SPACE_SETPOINT_DAY : SPACE_SETPOINT_NIGHT;
+
+        //Controller
+        if(lTime % p.nSamplePeriod == 0)
+        {
+            FilterReading(&sensors[ZONE_WATER], ReadSensor(dWater, rng), p.nFilterShift);
+            FilterReading(&sensors[ZONE_SPACE], ReadSensor(dSpace, rng), p.nFilterShift);
+        }
+        if(lTime % p.nControlPeriod == 0)
+        {
+            bool bWasOn = sched.bBoiler;
+            unsigned int nTransitions = sched.nTransitions;
+            for(unsigned int nSensor = 0; nSensor < 2; ++nSensor)
+                UpdateZone(&zones[sensors[nSensor].nZone], sensors[nSensor].nValue);
+            ScheduleDemand(&sched, zones, 2);
+            if(sched.bBoiler && !bWasOn)
+                ++res.lCycles;
+            res.lTransitions += (unsigned int)(sched.nTransitions - nTransitions); //Controller counters wrap at 16 bits
+        }
+        bool bBoiler = sched.bBoiler;
+        bool bPump = sched.bPump;
+
+        //Plant
+        double dOutdoor = h.dOutdoorMean - h.dOutdoorSwing * std::cos(2 * M_PI * nTimeOfDay / (24 * 3600.0));
+        double dTransfer = bPump ? h.dCoupling * (dEmitter - dSpace) : 0.1 * h.dCoupling * (dEmitter - dSpace);
+        dEmitter += ((bBoiler && bPump) ? h.dBoilerPower : 0) * dStep - dTransfer * dStep;
+        dSpace += (dTransfer / h.dMassRatio - h.dLoss * (dSpace - dOutdoor)) * dStep;
+        dWater += ((bBoiler && (sched.nValves & (1 << ZONE_WATER))) ? h.dCylinderPower : 0) * dStep - h.dCylinderLoss * (dWater - dSpace) * dStep;
+        if(nTimeOfDay == 7 * 3600 || nTimeOfDay == 19 * 3600)
+            dWater -= h.dDraw; //Morning and evening hot water draw
+
+        //Metrics
+        if(bBoiler)
+            res.lBurner += STEP;
+        if(bOccupied)
+        {
+            res.lOccupied += STEP;
+            if(std::fabs(dSpace - SPACE_SETPOINT_DAY / 10.0) <= COMFORT_BAND)
+                res.lComfort += STEP;
+        }
+    }
+    return res;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int nHouses = 32;
+    unsigned int nWeeks = 4;
+    unsigned int nThreads = std::max(1u, std::thread::hardware_concurrency());
+    unsigned long lSeed = 1;
+    bool bCsv = false;
+    for(int nArg = 1; nArg < argc; ++nArg)
+    {
+        if(0 == strcmp(argv[nArg], "-c"))
+            bCsv = true;
+        else if(nArg + 1 < argc && 0 == strcmp(argv[nArg], "-h"))
+            nHouses = atoi(argv[++nArg]);
+        else if(nArg + 1 < argc && 0 == strcmp(argv[nArg], "-w"))
+            nWeeks = atoi(argv[++nArg]);
+        else if(nArg + 1 < argc && 0 == strcmp(argv[nArg], "-t"))
+            nThreads = atoi(argv[++nArg]);
+        else if(nArg + 1 < argc && 0 == strcmp(argv[nArg], "-s"))
+            lSeed = strtoul(argv[++nArg], NULL, 10);
+        else
+        {
+            fprintf(stderr, "Usage: %s [-h houses] [-w weeks] [-t threads] [-s seed] [-c]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(nHouses == 0 || nWeeks == 0 || nThreads == 0)
+    {
+        fprintf(stderr, "Houses, weeks and threads must be greater than zero\n");
+        return 1;
+    }
+
+    std::vector<parameters> vParameters;
+    for(size_t nHyst = 0; nHyst < Count(SWEEP_HYST); ++nHyst)
+        for(size_t nControl = 0; nControl < Count(SWEEP_CONTROL); ++nControl)
+            for(size_t nSample = 0; nSample < Count(SWEEP_SAMPLE); ++nSample)
+                for(size_t nFilter = 0; nFilter < Count(SWEEP_FILTER); ++nFilter)
+                    for(size_t nSchedule = 0; nSchedule < Count(SWEEP_SCHEDULE); ++nSchedule)
+                    {
+                        parameters p = {SWEEP_HYST[nHyst], SWEEP_CONTROL[nControl], SWEEP_SAMPLE[nSample], SWEEP_FILTER[nFilter], SWEEP_SCHEDULE[nSchedule]};
+                        vParameters.push_back(p);
+                    }
+    std::vector<house> vHouses;
+    for(unsigned int nHouse = 0; nHouse < nHouses; ++nHouse)
+        vHouses.push_back(MakeHouse(nHouse, lSeed));
+
+    //One job per house per parameter set. Each job writes only its own result so no locking is required.
+    size_t lJobs = vParameters.size() * vHouses.size();
+    std::vector<result> vResults(lJobs);
+    WorkStealingPool pool(nThreads);
+    pool.Run(lJobs, [&](size_t lJob)
+    {
+        const parameters& p = vParameters[lJob / vHouses.size()];
+        const house& h = vHouses[lJob % vHouses.size()];
+        vResults[lJob] = Simulate(h, p, nWeeks, lSeed ^ (lJob * 2654435761UL));
+    });
+
+    if(bCsv)
+        printf("hysteresis,control,sample,filter,schedule,comfort,burner_hours,cycles,transitions,transitions_saved\n");
+    else
+        printf("Hyst Ctrl(s) Samp(s) Filt Sched Comfort%% Burner(h/wk) Cycles/wk Relays/wk Saved%%\n");
+    double dWeeks = (double)nWeeks * nHouses;
+    double dUnscheduled = 0; //Relay transitions of previous (unscheduled) set
+    for(size_t nSet = 0; nSet < vParameters.size(); ++nSet)
+    {
+        result total = {0, 0, 0, 0, 0};
+        for(size_t nHouse = 0; nHouse < vHouses.size(); ++nHouse)
+        {
+            const result& res = vResults[nSet * vHouses.size() + nHouse];
+            total.lComfort += res.lComfort;
+            total.lOccupied += res.lOccupied;
+            total.lBurner += res.lBurner;
+            total.lCycles += res.lCycles;
+            total.lTransitions += res.lTransitions;
+        }
+        const parameters& p = vParameters[nSet];
+        double dComfort = 100.0 * total.lComfort / total.lOccupied;
+        double dBurner = total.lBurner / 3600.0 / dWeeks;
+        double dCycles = total.lCycles / dWeeks;
+        double dTransitions = total.lTransitions / dWeeks;
+        double dSaved = 0;
+        if(p.nSchedule == SCHEDULE_OFF)
+            dUnscheduled = dTransitions;
+        else if(dUnscheduled > 0)
+            dSaved = 100.0 - 100.0 * dTransitions / dUnscheduled;
+        if(bCsv)
+            printf("%.1f,%u,%u,%u,%u,%.2f,%.2f,%.1f,%.1f,%.1f\n", p.nHyst / 10.0, p.nControlPeriod, p.nSamplePeriod, p.nFilterShift, p.nSchedule, dComfort, dBurner, dCycles, dTransitions, dSaved);
+        else
+            printf("%4.1f %7u %7u %4u %5s %8.2f %12.2f %9.1f %9.1f %6.1f\n", p.nHyst / 10.0, p.nControlPeriod, p.nSamplePeriod, p.nFilterShift, SCHEDULE_NAME[p.nSchedule], dComfort, dBurner, dCycles, dTransitions, dSaved);
+    }
+    fprintf(stderr, "%lu jobs (%.0f simulated weeks) on %u threads, %lu stolen\n", (unsigned long)lJobs, (double)lJobs * nWeeks, nThreads, pool.GetSteals());
+    return 0;
+}
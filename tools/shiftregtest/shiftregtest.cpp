@@ -0,0 +1,115 @@
+/** riban heating controller - shift register test
+*   Host test of ShiftRegister (shiftreg.h) driving a model of two daisy-chained 74HC595 on the controller's valve pins.
+*   The model shifts the data pin into its shift register on each rising edge of the clock pin and copies the shift
+*   register to its outputs on each rising edge of the latch pin, recording each latched frame and the clock edges before it.
+*
+*   Checks:
+*       Begin configures the pins as outputs and latches all outputs off (valves closed) from any power-up state
+*       Bit 0 of a frame appears on Q0 of the register nearest the MCU and bit 15 on Q7 of the far register
+*       Each frame is a full chain of clock edges followed by one latch
+*       Writing the outputs already latched clocks and latches nothing
+*
+*   Usage: shiftregtest
+*       Returns 0 if all checks pass
+*/
+
+#include "shiftreg.h"
+#include <cstdio>
+
+const byte PIN_DATA = 11; //As controller SER
+const byte PIN_LATCH = 12; //As controller RCLK
+const byte PIN_CLOCK = 13; //As controller SRCLK
+const byte REGISTERS = 2;
+
+struct chain
+{
+    unsigned int nShift; //Content of shift registers. Bit 0 = Q0 of register nearest MCU.
+    unsigned int nOutputs; //Latched outputs
+    unsigned int nClocks; //Clock edges since last latch
+    unsigned int nLatches; //Quantity of latches
+    unsigned int nLastClocks; //Clock edges before last latch
+};
+
+chain g_chain;
+ShiftRegister<PIN_DATA, PIN_CLOCK, PIN_LATCH, REGISTERS> g_register;
+unsigned int g_nFailures = 0;
+
+/** @brief  Models 74HC595 chain from pin changes
+*   @param  nPin Pin that changed
+*   @param  bValue New state of pin
+*/
+void OnPin(byte nPin, bool bValue)
+{
+    if(!bValue)
+        return;
+    if(nPin == PIN_CLOCK)
+    {
+        g_chain.nShift = (g_chain.nShift << 1) | (FastPin<PIN_DATA>::Get() ? 1 : 0);
+        ++g_chain.nClocks;
+    }
+    else if(nPin == PIN_LATCH)
+    {
+        g_chain.nOutputs = g_chain.nShift & ((1UL << (REGISTERS * 8)) - 1);
+        g_chain.nLastClocks = g_chain.nClocks;
+        g_chain.nClocks = 0;
+        ++g_chain.nLatches;
+    }
+}
+
+/** @brief  Reports a check
+*   @param  bPass True if check passed
+*   @param  sCheck Description of check
+*/
+void Check(bool bPass, const char* sCheck)
+{
+    printf("%s %s\n", bPass ? "pass" : "FAIL", sCheck);
+    if(!bPass)
+        ++g_nFailures;
+}
+
+/** @brief  Writes a frame and checks it is latched in full
+*   @param  nBits Frame to write
+*   @param  sCheck Description of check
+*/
+void CheckFrame(unsigned int nBits, const char* sCheck)
+{
+    unsigned int nLatches = g_chain.nLatches;
+    bool bWritten = g_register.Write(nBits);
+    Check(bWritten && g_chain.nLatches == nLatches + 1 && g_chain.nLastClocks == REGISTERS * 8u
+        && g_chain.nOutputs == nBits && g_register.Read() == nBits, sCheck);
+}
+
+int main()
+{
+    FastPinGetHook() = OnPin;
+    g_chain.nShift = 0xA5C3; //Power-up state is undefined
+    g_chain.nOutputs = 0xA5C3;
+
+    g_register.Begin();
+    Check((FastPin<PIN_DATA>::Direction() & FastPin<PIN_DATA>::MASK) && (FastPin<PIN_CLOCK>::Direction() & FastPin<PIN_CLOCK>::MASK)
+        && (FastPin<PIN_LATCH>::Direction() & FastPin<PIN_LATCH>::MASK), "Begin sets pins as outputs");
+    Check(g_chain.nLatches == 1 && g_chain.nLastClocks == REGISTERS * 8u && g_chain.nOutputs == 0, "Begin latches all valves closed");
+    Check(!FastPin<PIN_CLOCK>::Get() && !FastPin<PIN_LATCH>::Get(), "Clock and latch left low");
+
+    CheckFrame(0x0001, "Bit 0 on Q0 of near register");
+    CheckFrame(0x0080, "Bit 7 on Q7 of near register");
+    CheckFrame(0x0100, "Bit 8 on Q0 of far register");
+    CheckFrame(0x8000, "Bit 15 on Q7 of far register");
+    CheckFrame(0x1234, "Mixed frame");
+
+    unsigned int nLatches = g_chain.nLatches;
+    unsigned int nFrames = g_register.nFrames;
+    bool bWritten = g_register.Write(0x1234);
+    Check(!bWritten && g_chain.nLatches == nLatches && g_chain.nClocks == 0 && g_register.nFrames == nFrames, "Unchanged frame not clocked or latched");
+
+    CheckFrame(0x1235, "Changed frame latched");
+    CheckFrame(0x0000, "All valves closed");
+
+    nLatches = g_chain.nLatches;
+    g_chain.nOutputs = 0xFFFF; //Outputs disturbed, e.g. by supply glitch
+    g_register.Begin();
+    Check(g_chain.nLatches == nLatches + 1 && g_chain.nOutputs == 0, "Begin latches all valves closed when frame is unchanged");
+
+    printf("%u failures\n", g_nFailures);
+    return g_nFailures ? 1 : 0;
+}
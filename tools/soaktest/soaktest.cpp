@@ -0,0 +1,428 @@
+/** riban heating controller - serial soak tester
+*   Host tool to measure how text command handling holds up while the controller is busy with acquisition and display.
+*   Sends a weighted mix of the read-only S (sensors), E (events), Z (zones) and T (time) listing commands to a
+*   controller on a serial port or pty at a controlled rate and matches each response to its command.
+*   Configuration forms of these commands are not sent as each would write EEPROM.
+*
+*   Commands are sent open loop (without waiting for responses) so that a rate beyond what the controller sustains shows
+*   as growing latency and, once the controller's receive buffer overflows, as lost or garbled responses.
+*
+*   Reported for each rate step:
+*       Requested and achieved command rate (completed responses per second)
+*       Sent, completed, lost (no response within timeout or skipped) and garbled (malformed body) commands
+*       Other lines - lines outside any response, e.g. log output. Disable logging (V 0 00) for a clean run.
+*       Response latency percentiles (ms) from end of command to last line of response
+*   With -R the rate is raised by RAMP_FACTOR each step until a step fails (more than MAX_FAILED of commands lost or
+*   garbled or achieved rate below MIN_ACHIEVED of requested). The highest passing rate is reported as sustainable.
+*
+*   T produces no response if the RTC does not respond, so leave T out of the mix (-m S1E1Z1) when testing without a clock.
+*
+*   Usage: soaktest -p port [-b baud] [-m mix] [-r rate] [-d seconds] [-t timeout] [-R] [-l label] [-s seed] [-c]
+*       -m command weights, e.g. S2E1Z1T4 (default S1E1Z1T1)
+*       -r commands per second (default 1, first step when ramping)
+*       -l label, e.g. firmware version, printed in each report row
+*       -c prints comma separated values instead of a table
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+typedef std::chrono::steady_clock clock_type;
+
+const double RAMP_FACTOR = 1.5; //Rate multiplier between ramp steps
+const unsigned int RAMP_MAX_STEPS = 16;
+const double MAX_FAILED = 0.01; //Maximum proportion of lost or garbled commands in a passing step
+const double MIN_ACHIEVED = 0.9; //Minimum proportion of requested rate completed in a passing step
+const unsigned int ZONES = 10; //Lines in zone listing
+const unsigned int RESET_WAIT_MS = 2000; //Wait after opening port for controller to restart (DTR reset)
+const char COMMANDS[] = "SEZT";
+
+struct command
+{
+    char cCommand; //S, E, Z or T
+    clock_type::time_point tSent;
+};
+
+struct step
+{
+    double dRequested; //Requested rate (commands/s)
+    double dDuration; //Duration of sending (s)
+    unsigned long lSent;
+    unsigned long lCompleted;
+    unsigned long lLost;
+    unsigned long lGarbled;
+    unsigned long lOther; //Lines outside any response
+    std::vector<double> vLatency; //Latency of each completed command (ms)
+};
+
+/** @brief  Matches response lines to commands
+*   @note   Controller handles commands in order so each response belongs to the oldest outstanding command of its type.
+*           Older outstanding commands of other types have been lost, e.g. dropped by receive buffer overflow.
+*/
+class Matcher
+{
+    public:
+        Matcher(step& s) : m_step(s), m_cActive(0), m_nBody(0) {}
+
+        /** @brief  Adds a sent command */
+        void Sent(char cCommand)
+        {
+            command c = {cCommand, clock_type::now()};
+            m_pending.push_back(c);
+            ++m_step.lSent;
+        }
+
+        /** @brief  Processes a received line
+        *   @param  sLine Line without end of line characters
+        */
+        void Line(const std::string& sLine)
+        {
+            if(m_cActive && Body(sLine))
+                return;
+            unsigned int nQuantity;
+            if(1 == sscanf(sLine.c_str(), "List sensors - quantity=%u", &nQuantity))
+                Start('S', nQuantity);
+            else if(1 == sscanf(sLine.c_str(), "List events - quantity=%u", &nQuantity))
+                Start('E', nQuantity);
+            else if(sLine == "List zones")
+                Start('Z', ZONES);
+            else if(IsTime(sLine))
+                Start('T', 0);
+            else if(sLine.compare(0, 11, "I2C errors=") != 0) //Follows time when bus has failed
+                ++m_step.lOther;
+        }
+
+        /** @brief  Counts commands without response within timeout as lost
+        *   @param  dTimeout Timeout (s)
+        */
+        void Expire(double dTimeout)
+        {
+            clock_type::time_point tNow = clock_type::now();
+            while(!m_pending.empty() && std::chrono::duration<double>(tNow - m_pending.front().tSent).count() > dTimeout)
+            {
+                m_pending.pop_front();
+                ++m_step.lLost;
+            }
+            if(m_cActive && std::chrono::duration<double>(tNow - m_active.tSent).count() > dTimeout)
+            {
+                m_cActive = 0;
+                ++m_step.lLost;
+            }
+        }
+
+        /** @brief  Checks whether any command is outstanding */
+        bool Busy() { return m_cActive || !m_pending.empty(); }
+
+    private:
+        /** @brief  Starts a response
+        *   @param  cCommand Command the response belongs to
+        *   @param  nBody Quantity of body lines expected
+        */
+        void Start(char cCommand, unsigned int nBody)
+        {
+            std::deque<command>::iterator it = m_pending.begin();
+            while(it != m_pending.end() && it->cCommand != cCommand)
+                ++it;
+            if(it == m_pending.end())
+            {
+                ++m_step.lOther; //Response to no outstanding command
+                return;
+            }
+            m_step.lLost += it - m_pending.begin();
+            m_active = *it;
+            m_pending.erase(m_pending.begin(), it + 1);
+            m_cActive = cCommand;
+            m_nBody = nBody;
+            if(nBody == 0 && cCommand != 'E')
+                Complete();
+        }
+
+        /** @brief  Processes a line of the active response
+        *   @return <i>bool</i> True if line belongs to response. False if response was garbled.
+        */
+        bool Body(const std::string& sLine)
+        {
+            if(m_nBody)
+            {
+                unsigned int nIndex;
+                int nLength = 0;
+                if(1 == sscanf(sLine.c_str(), "%u: %n", &nIndex, &nLength) && nLength && sLine.find('=') != std::string::npos)
+                {
+                    if(--m_nBody == 0 && m_cActive != 'E')
+                        Complete();
+                    return true;
+                }
+            }
+            else if(m_cActive == 'E' && sLine.compare(0, 14, "Next event at ") == 0)
+            {
+                Complete();
+                return true;
+            }
+            m_cActive = 0;
+            ++m_step.lGarbled;
+            return false;
+        }
+
+        /** @brief  Records latency of completed response */
+        void Complete()
+        {
+            m_step.vLatency.push_back(std::chrono::duration<double, std::milli>(clock_type::now() - m_active.tSent).count());
+            ++m_step.lCompleted;
+            m_cActive = 0;
+        }
+
+        /** @brief  Checks for time line "hh:mm:ss  Dow d/mm/yy" */
+        static bool IsTime(const std::string& sLine)
+        {
+            return sLine.size() >= 8 && isdigit(sLine[0]) && isdigit(sLine[1]) && sLine[2] == ':' && isdigit(sLine[3])
+                && isdigit(sLine[4]) && sLine[5] == ':' && isdigit(sLine[6]) && isdigit(sLine[7]);
+        }
+
+        step& m_step;
+        std::deque<command> m_pending; //Commands sent without response
+        command m_active; //Command of response being received
+        char m_cActive; //Command of response being received. 0 for none.
+        unsigned int m_nBody; //Quantity of body lines still expected
+};
+
+/** @brief  Opens and configures serial port
+*   @param  sPort Path of serial device or pty
+*   @param  nBaud Baud rate
+*   @return <i>int</i> File descriptor or -1 on failure
+*/
+int OpenPort(const char* sPort, unsigned int nBaud)
+{
+    speed_t nSpeed;
+    switch(nBaud)
+    {
+        case 9600: nSpeed = B9600; break;
+        case 19200: nSpeed = B19200; break;
+        case 38400: nSpeed = B38400; break;
+        case 57600: nSpeed = B57600; break;
+        case 115200: nSpeed = B115200; break;
+        default:
+            fprintf(stderr, "Unsupported baud rate %u\n", nBaud);
+            return -1;
+    }
+    int nFd = open(sPort, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if(nFd < 0)
+    {
+        perror(sPort);
+        return -1;
+    }
+    termios tio;
+    if(0 == tcgetattr(nFd, &tio))
+    {
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, nSpeed);
+        cfsetospeed(&tio, nSpeed);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tcsetattr(nFd, TCSANOW, &tio);
+    }
+    return nFd;
+}
+
+/** @brief  Reads available data and passes each complete line to matcher
+*   @param  nFd Port file descriptor
+*   @param  sPartial Incomplete line carried between calls
+*   @param  matcher Response matcher
+*   @param  nWaitMs Maximum time to wait for data (ms)
+*/
+void Receive(int nFd, std::string& sPartial, Matcher& matcher, int nWaitMs)
+{
+    pollfd pfd = {nFd, POLLIN, 0};
+    if(poll(&pfd, 1, std::max(nWaitMs, 0)) <= 0)
+        return;
+    char buffer[256];
+    ssize_t nRead;
+    while((nRead = read(nFd, buffer, sizeof(buffer))) > 0)
+    {
+        for(ssize_t i = 0; i < nRead; ++i)
+        {
+            if(buffer[i] == '\n' || buffer[i] == '\r')
+            {
+                if(!sPartial.empty())
+                    matcher.Line(sPartial);
+                sPartial.clear();
+            }
+            else
+                sPartial += buffer[i];
+        }
+    }
+}
+
+/** @brief  Runs one rate step
+*   @param  nFd Port file descriptor
+*   @param  sMix Weighted command sequence to choose from
+*   @param  dRate Commands per second
+*   @param  dDuration Duration of sending (s)
+*   @param  dTimeout Response timeout (s)
+*   @param  rng Random number generator
+*   @return <i>step</i> Results
+*/
+step RunStep(int nFd, const std::string& sMix, double dRate, double dDuration, double dTimeout, std::mt19937& rng)
+{
+    step s = {dRate, dDuration, 0, 0, 0, 0, 0, std::vector<double>()};
+    Matcher matcher(s);
+    std::string sPartial;
+    std::uniform_int_distribution<size_t> choose(0, sMix.size() - 1);
+    clock_type::time_point tStart = clock_type::now();
+    clock_type::time_point tEnd = tStart + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(dDuration));
+    clock_type::duration period = std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(1.0 / dRate));
+    clock_type::time_point tNext = tStart;
+    while(clock_type::now() < tEnd)
+    {
+        if(clock_type::now() >= tNext)
+        {
+            char sCommand[2] = {sMix[choose(rng)], '\n'};
+            if(write(nFd, sCommand, 2) == 2)
+            {
+                tcdrain(nFd); //Latency is measured from end of command
+                matcher.Sent(sCommand[0]);
+            }
+            tNext += period; //Fixed schedule so a slow write does not lower the rate
+        }
+        int nWait = std::chrono::duration_cast<std::chrono::milliseconds>(std::min(tNext, tEnd) - clock_type::now()).count();
+        Receive(nFd, sPartial, matcher, nWait);
+        matcher.Expire(dTimeout);
+    }
+    //Collect responses to commands already sent
+    clock_type::time_point tDrain = clock_type::now() + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(dTimeout));
+    while(matcher.Busy() && clock_type::now() < tDrain)
+    {
+        Receive(nFd, sPartial, matcher, 50);
+        matcher.Expire(dTimeout);
+    }
+    matcher.Expire(0);
+    s.dDuration = std::chrono::duration<double>(clock_type::now() - tStart).count();
+    return s;
+}
+
+/** @brief  Gets a percentile from sorted values
+*   @param  vValues Sorted values
+*   @param  dPercentile Percentile (0-100)
+*   @return <i>double</i> Value at percentile or 0 if no values
+*/
+double Percentile(const std::vector<double>& vValues, double dPercentile)
+{
+    if(vValues.empty())
+        return 0;
+    size_t nIndex = (size_t)(dPercentile / 100.0 * (vValues.size() - 1) + 0.5);
+    return vValues[nIndex];
+}
+
+/** @brief  Checks whether a step sustained its requested rate */
+bool Passed(const step& s)
+{
+    if(s.lSent == 0)
+        return false;
+    return (double)(s.lLost + s.lGarbled) / s.lSent <= MAX_FAILED && s.lCompleted / s.dDuration >= MIN_ACHIEVED * s.dRequested;
+}
+
+int main(int argc, char** argv)
+{
+    const char* sPort = NULL;
+    unsigned int nBaud = 9600;
+    std::string sMixSpec = "S1E1Z1T1";
+    double dRate = 1.0;
+    double dDuration = 30.0;
+    double dTimeout = 5.0;
+    bool bRamp = false;
+    std::string sLabel = "-";
+    unsigned long lSeed = 1;
+    bool bCsv = false;
+    for(int nArg = 1; nArg < argc; ++nArg)
+    {
+        if(0 == strcmp(argv[nArg], "-R"))
+            bRamp = true;
+        else if(0 == strcmp(argv[nArg], "-c"))
+            bCsv = true;
+        else if(nArg + 1 < argc && 0 == strcmp(argv[nArg], "-p"))
+            sPort = argv[++nArg];
+        else if(nArg + 1 < argc && 0 == strcmp(argv[nArg], "-b"))
+            nBaud = atoi(argv[++nArg]);
+        else if(nArg + 1 < argc && 0 == strcmp(argv[nArg], "-m"))
+            sMixSpec = argv[++nArg];
+        else if(nArg + 1 < argc && 0 == strcmp(argv[nArg], "-r"))
+            dRate = atof(argv[++nArg]);
+        else if(nArg + 1 < argc && 0 == strcmp(argv[nArg], "-d"))
+            dDuration = atof(argv[++nArg]);
+        else if(nArg + 1 < argc && 0 == strcmp(argv[nArg], "-t"))
+            dTimeout = atof(argv[++nArg]);
+        else if(nArg + 1 < argc && 0 == strcmp(argv[nArg], "-l"))
+            sLabel = argv[++nArg];
+        else if(nArg + 1 < argc && 0 == strcmp(argv[nArg], "-s"))
+            lSeed = strtoul(argv[++nArg], NULL, 10);
+        else
+        {
+            fprintf(stderr, "Usage: %s -p port [-b baud] [-m mix] [-r rate] [-d seconds] [-t timeout] [-R] [-l label] [-s seed] [-c]\n", argv[0]);
+            return 1;
+        }
+    }
+    //Expand mix, e.g. S2E1 to SSE, so each command is chosen in proportion to its weight
+    std::string sMix;
+    for(size_t nPos = 0; nPos < sMixSpec.size();)
+    {
+        char cCommand = sMixSpec[nPos++];
+        unsigned int nWeight = 0;
+        while(nPos < sMixSpec.size() && isdigit(sMixSpec[nPos]))
+            nWeight = nWeight * 10 + sMixSpec[nPos++] - '0';
+        if(cCommand == 0 || !strchr(COMMANDS, cCommand))
+        {
+            fprintf(stderr, "Mix may only contain S, E, Z and T each followed by a weight\n");
+            return 1;
+        }
+        sMix.append(nWeight, cCommand);
+    }
+    if(!sPort || sMix.empty() || dRate <= 0 || dDuration <= 0 || dTimeout <= 0)
+    {
+        fprintf(stderr, "Port, a mix with non-zero weight, rate, duration and timeout are required\n");
+        return 1;
+    }
+    int nFd = OpenPort(sPort, nBaud);
+    if(nFd < 0)
+        return 1;
+    usleep(RESET_WAIT_MS * 1000);
+    tcflush(nFd, TCIOFLUSH); //Discard start-up output
+
+    if(bCsv)
+        printf("label,mix,requested,achieved,sent,completed,lost,garbled,other,p50_ms,p90_ms,p99_ms,max_ms\n");
+    else
+        printf("Label        Req/s  Done/s   Sent   Done   Lost Garbled  Other  p50(ms)  p90(ms)  p99(ms)  max(ms)\n");
+    std::mt19937 rng(lSeed);
+    double dSustained = 0;
+    for(unsigned int nStep = 0; nStep < (bRamp ? RAMP_MAX_STEPS : 1); ++nStep)
+    {
+        step s = RunStep(nFd, sMix, dRate, dDuration, dTimeout, rng);
+        std::sort(s.vLatency.begin(), s.vLatency.end());
+        double dAchieved = s.lCompleted / s.dDuration;
+        if(bCsv)
+            printf("%s,%s,%.3f,%.3f,%lu,%lu,%lu,%lu,%lu,%.1f,%.1f,%.1f,%.1f\n", sLabel.c_str(), sMixSpec.c_str(), dRate, dAchieved,
+                s.lSent, s.lCompleted, s.lLost, s.lGarbled, s.lOther, Percentile(s.vLatency, 50), Percentile(s.vLatency, 90),
+                Percentile(s.vLatency, 99), Percentile(s.vLatency, 100));
+        else
+            printf("%-10s %7.2f %7.2f %6lu %6lu %6lu %7lu %6lu %8.1f %8.1f %8.1f %8.1f\n", sLabel.c_str(), dRate, dAchieved,
+                s.lSent, s.lCompleted, s.lLost, s.lGarbled, s.lOther, Percentile(s.vLatency, 50), Percentile(s.vLatency, 90),
+                Percentile(s.vLatency, 99), Percentile(s.vLatency, 100));
+        fflush(stdout);
+        if(!Passed(s))
+            break;
+        dSustained = dRate;
+        dRate *= RAMP_FACTOR;
+    }
+    if(bRamp)
+        fprintf(stderr, "Maximum sustainable rate %.2f commands/s (mix %s, %u baud)\n", dSustained, sMixSpec.c_str(), nBaud);
+    close(nFd);
+    return 0;
+}
@@ -0,0 +1,662 @@
+/** riban heating controller - telemetry store
+*   Host tool that collects sensor readings from controller journal images (external EEPROM content, see journal.h) into a
+*   store and answers range queries such as daily minimum / maximum of each sensor over a winter.
+*
+*   Readings stay in the controller's compact format (C/100 in 16 bits) in one column per series with a parallel column
+*   of minutes. Each series keeps rollups of 10 minute, hourly and daily buckets, updated as each reading is appended,
+*   as columns of minimum, maximum, sum and count. Empty buckets hold extreme minimum / maximum so they need no test.
+*   A query uses whole buckets of the coarsest rollup that fits and only the ends of the range fall through to finer
+*   rollups and finally to the raw readings, so a year long daily query reads about 365 buckets per series.
+*   Raw readings and rollup minimum / maximum columns are scanned with SSE2 (8 values per instruction) where available.
+*
+*   Journal records hold minutes since 00:00 Sunday. Each controller's weeks are counted from its first journal page
+*   (day 0 is that Sunday) and a week is added wherever time decreases.
+*   Pages with a sequence already in the store are skipped so the same controller's images may be loaded repeatedly.
+*   Images must be loaded before the journal wraps. It holds JOURNAL_PAGES x JOURNAL_RECORDS (5120) records and the
+*   controller records each sensor every 10 minutes plus each relay transition, writing at least one page per hour, so
+*   with 10 sensors it wraps in about 85 hours (3.5 days) and with 2 sensors in about 10 days. A gap in sequence since
+*   the previous image of a controller is reported as lost pages; readings either side are kept but a lost week
+*   roll-over puts later readings a week early.
+*   The journal records sensors, not zones, so series are per controller sensor.
+*
+*   Usage: telemetry [-s store] [-r m|h|d] [-f day] [-t day] [-c] [name=image ...]
+*          telemetry -b [-n controllers] [-k sensors] [-y days]
+*       -s store file loaded before and saved after adding images
+*       -r resolution of listing: m = 10 minutes, h = hourly, d = daily. Without -r one summary row per series is listed.
+*       -f, -t first and last+1 day of listing (default all)
+*       -c prints comma separated values instead of a table
+*       -b benchmarks a year long daily query on synthetic readings using rollups, SIMD scan and scalar scan
+*/
+
+#include "journal.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif // __SSE2__
+
+const int MINUTES_PER_DAY = 1440;
+const int MINUTES_PER_WEEK = 7 * MINUTES_PER_DAY;
+const int LEVELS = 3; //Quantity of rollups
+const int LEVEL_MINUTES[LEVELS] = {10, 60, MINUTES_PER_DAY}; //Bucket duration of each rollup, each a multiple of the one before
+const char STORE_MAGIC[8] = "RHCTS01";
+
+struct aggregate
+{
+    int nMin; //C/100
+    int nMax; //C/100
+    long long llSum; //C/100
+    unsigned long lCount;
+};
+
+const aggregate EMPTY = {INT16_MAX, INT16_MIN, 0, 0};
+
+/** @brief  Merges one aggregate into another */
+void Merge(aggregate& agg, const aggregate& other)
+{
+    agg.nMin = std::min(agg.nMin, other.nMin);
+    agg.nMax = std::max(agg.nMax, other.nMax);
+    agg.llSum += other.llSum;
+    agg.lCount += other.lCount;
+}
+
+/** @brief  Scans values for minimum, maximum and sum without SIMD (reference and benchmark) */
+void ScanScalar(const int16_t* pValues, size_t nCount, aggregate& agg)
+{
+    for(size_t i = 0; i < nCount; ++i)
+    {
+        agg.nMin = std::min(agg.nMin, (int)pValues[i]);
+        agg.nMax = std::max(agg.nMax, (int)pValues[i]);
+        agg.llSum += pValues[i];
+    }
+    agg.lCount += nCount;
+}
+
+/** @brief  Scans values for minimum, maximum and sum
+*   @param  pValues Pointer to first value
+*   @param  nCount Quantity of values
+*   @param  agg Aggregate to merge result into
+*   @note   Pairs are summed to 32-bit lanes which are added to the 64-bit total before they can overflow
+*/
+void Scan(const int16_t* pValues, size_t nCount, aggregate& agg)
+{
+#ifdef __SSE2__
+    const size_t FLUSH = 16384; //Iterations before 32-bit lanes could overflow
+    __m128i vMin = _mm_set1_epi16(INT16_MAX);
+    __m128i vMax = _mm_set1_epi16(INT16_MIN);
+    const __m128i vOnes = _mm_set1_epi16(1);
+    size_t i = 0;
+    while(i + 8 <= nCount)
+    {
+        __m128i vSum = _mm_setzero_si128();
+        for(size_t nIteration = 0; nIteration < FLUSH && i + 8 <= nCount; ++nIteration, i += 8)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*)(pValues + i));
+            vMin = _mm_min_epi16(vMin, v);
+            vMax = _mm_max_epi16(vMax, v);
+            vSum = _mm_add_epi32(vSum, _mm_madd_epi16(v, vOnes));
+        }
+        int32_t sums[4];
+        _mm_storeu_si128((__m128i*)sums, vSum);
+        agg.llSum += (long long)sums[0] + sums[1] + sums[2] + sums[3];
+    }
+    int16_t mins[8], maxs[8];
+    _mm_storeu_si128((__m128i*)mins, vMin);
+    _mm_storeu_si128((__m128i*)maxs, vMax);
+    for(int nLane = 0; nLane < 8; ++nLane)
+    {
+        agg.nMin = std::min(agg.nMin, (int)mins[nLane]);
+        agg.nMax = std::max(agg.nMax, (int)maxs[nLane]);
+    }
+    agg.lCount += i;
+    ScanScalar(pValues + i, nCount - i, agg);
+#else
+    ScanScalar(pValues, nCount, agg);
+#endif // __SSE2__
+}
+
+/** @brief  Gets minimum of values
+*   @note   Used for rollup minimum columns. Result is INT16_MAX if there are no values.
+*/
+int Min(const int16_t* pValues, size_t nCount)
+{
+    int nMin = INT16_MAX;
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128i vMin = _mm_set1_epi16(INT16_MAX);
+    for(; i + 8 <= nCount; i += 8)
+        vMin = _mm_min_epi16(vMin, _mm_loadu_si128((const __m128i*)(pValues + i)));
+    int16_t mins[8];
+    _mm_storeu_si128((__m128i*)mins, vMin);
+    for(int nLane = 0; nLane < 8; ++nLane)
+        nMin = std::min(nMin, (int)mins[nLane]);
+#endif // __SSE2__
+    for(; i < nCount; ++i)
+        nMin = std::min(nMin, (int)pValues[i]);
+    return nMin;
+}
+
+/** @brief  Gets maximum of values
+*   @note   Used for rollup maximum columns. Result is INT16_MIN if there are no values.
+*/
+int Max(const int16_t* pValues, size_t nCount)
+{
+    int nMax = INT16_MIN;
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128i vMax = _mm_set1_epi16(INT16_MIN);
+    for(; i + 8 <= nCount; i += 8)
+        vMax = _mm_max_epi16(vMax, _mm_loadu_si128((const __m128i*)(pValues + i)));
+    int16_t maxs[8];
+    _mm_storeu_si128((__m128i*)maxs, vMax);
+    for(int nLane = 0; nLane < 8; ++nLane)
+        nMax = std::max(nMax, (int)maxs[nLane]);
+#endif // __SSE2__
+    for(; i < nCount; ++i)
+        nMax = std::max(nMax, (int)pValues[i]);
+    return nMax;
+}
+
+/** @brief  Buckets of one duration covering a series, as columns indexed by bucket number - first bucket */
+class Rollup
+{
+    public:
+        Rollup(int nMinutes = 10) : m_nMinutes(nMinutes), m_nFirst(-1) {}
+
+        /** @brief  Adds a reading to its bucket, adding empty buckets for any gap */
+        void Add(int nMinute, int16_t nValue)
+        {
+            int nBucket = nMinute / m_nMinutes;
+            if(m_nFirst < 0)
+                m_nFirst = nBucket;
+            if(nBucket < m_nFirst)
+                return; //Before start of series
+            size_t nIndex = nBucket - m_nFirst;
+            if(nIndex >= m_vMin.size())
+            {
+                m_vMin.resize(nIndex + 1, INT16_MAX);
+                m_vMax.resize(nIndex + 1, INT16_MIN);
+                m_vSum.resize(nIndex + 1, 0);
+                m_vCount.resize(nIndex + 1, 0);
+            }
+            m_vMin[nIndex] = std::min(m_vMin[nIndex], nValue);
+            m_vMax[nIndex] = std::max(m_vMax[nIndex], nValue);
+            m_vSum[nIndex] += nValue;
+            ++m_vCount[nIndex];
+        }
+
+        /** @brief  Aggregates whole buckets
+        *   @param  nFrom First bucket number
+        *   @param  nTo Bucket number after last
+        *   @param  agg Aggregate to merge result into
+        */
+        void Query(int nFrom, int nTo, aggregate& agg) const
+        {
+            if(m_nFirst < 0)
+                return;
+            nFrom = std::max(nFrom - m_nFirst, 0);
+            nTo = std::min(nTo - m_nFirst, (int)m_vMin.size());
+            if(nFrom >= nTo)
+                return;
+            agg.nMin = std::min(agg.nMin, Min(&m_vMin[nFrom], nTo - nFrom));
+            agg.nMax = std::max(agg.nMax, Max(&m_vMax[nFrom], nTo - nFrom));
+            for(int nIndex = nFrom; nIndex < nTo; ++nIndex)
+            {
+                agg.llSum += m_vSum[nIndex];
+                agg.lCount += m_vCount[nIndex];
+            }
+        }
+
+        int GetMinutes() const { return m_nMinutes; }
+
+    private:
+        int m_nMinutes; //Bucket duration
+        int m_nFirst; //Bucket number of first bucket. -1 when empty.
+        std::vector<int16_t> m_vMin;
+        std::vector<int16_t> m_vMax;
+        std::vector<int64_t> m_vSum;
+        std::vector<uint32_t> m_vCount;
+};
+
+/** @brief  Readings of one sensor of one controller with their rollups */
+class Series
+{
+    public:
+        Series(size_t nController, byte nSensor) : m_nController(nController), m_nSensor(nSensor)
+        {
+            for(int nLevel = 0; nLevel < LEVELS; ++nLevel)
+                m_rollups[nLevel] = Rollup(LEVEL_MINUTES[nLevel]);
+        }
+
+        /** @brief  Appends a reading
+        *   @param  nMinute Minutes since 00:00 of day 0
+        *   @param  nValue Temperature (C/100)
+        */
+        void Append(int nMinute, int16_t nValue)
+        {
+            m_vMinute.push_back(nMinute);
+            m_vValue.push_back(nValue);
+            for(int nLevel = 0; nLevel < LEVELS; ++nLevel)
+                m_rollups[nLevel].Add(nMinute, nValue);
+        }
+
+        /** @brief  Aggregates readings in a range of time using rollups
+        *   @param  nFrom First minute
+        *   @param  nTo Minute after last
+        *   @return <i>aggregate</i> Minimum, maximum, sum and count
+        */
+        aggregate Query(int nFrom, int nTo) const
+        {
+            aggregate agg = EMPTY;
+            QueryLevel(LEVELS - 1, nFrom, nTo, agg);
+            return agg;
+        }
+
+        /** @brief  Aggregates readings in a range of time by scanning raw readings
+        *   @param  bSimd True to use SIMD scan, false for scalar (benchmark)
+        */
+        aggregate QueryRaw(int nFrom, int nTo, bool bSimd = true) const
+        {
+            aggregate agg = EMPTY;
+            size_t nBegin = std::lower_bound(m_vMinute.begin(), m_vMinute.end(), nFrom) - m_vMinute.begin();
+            size_t nEnd = std::lower_bound(m_vMinute.begin() + nBegin, m_vMinute.end(), nTo) - m_vMinute.begin();
+            if(bSimd)
+                Scan(m_vValue.data() + nBegin, nEnd - nBegin, agg);
+            else
+                ScanScalar(m_vValue.data() + nBegin, nEnd - nBegin, agg);
+            return agg;
+        }
+
+        size_t GetController() const { return m_nController; }
+        byte GetSensor() const { return m_nSensor; }
+        size_t GetSize() const { return m_vValue.size(); }
+        int GetFirst() const { return m_vMinute.empty() ? 0 : m_vMinute.front(); }
+        int GetLast() const { return m_vMinute.empty() ? 0 : m_vMinute.back(); }
+        const std::vector<int32_t>& GetMinutes() const { return m_vMinute; }
+        const std::vector<int16_t>& GetValues() const { return m_vValue; }
+
+    private:
+        /** @brief  Aggregates whole buckets of a rollup and passes the partial buckets at each end to the finer level
+        *   @param  nLevel Rollup level. -1 for raw readings.
+        */
+        void QueryLevel(int nLevel, int nFrom, int nTo, aggregate& agg) const
+        {
+            if(nFrom >= nTo)
+                return;
+            if(nLevel < 0)
+            {
+                Merge(agg, QueryRaw(nFrom, nTo));
+                return;
+            }
+            int nMinutes = m_rollups[nLevel].GetMinutes();
+            int nFirst = (nFrom + nMinutes - 1) / nMinutes; //First whole bucket
+            int nLast = nTo / nMinutes; //Bucket after last whole bucket
+            if(nFirst >= nLast)
+            {
+                QueryLevel(nLevel - 1, nFrom, nTo, agg);
+                return;
+            }
+            QueryLevel(nLevel - 1, nFrom, nFirst * nMinutes, agg);
+            m_rollups[nLevel].Query(nFirst, nLast, agg);
+            QueryLevel(nLevel - 1, nLast * nMinutes, nTo, agg);
+        }
+
+        size_t m_nController;
+        byte m_nSensor;
+        std::vector<int32_t> m_vMinute; //Minutes since 00:00 of day 0
+        std::vector<int16_t> m_vValue; //C/100
+        Rollup m_rollups[LEVELS];
+};
+
+struct controller
+{
+    std::string sName;
+    long lLastSequence; //Sequence of newest page in store. -1 for none.
+    long lWeek; //Weeks since day 0 of newest record
+    int nLastMinute; //Minutes since 00:00 Sunday of newest record
+};
+
+/** @brief  Readings of all controllers */
+class Store
+{
+    public:
+        /** @brief  Gets index of a controller, adding it if new */
+        size_t GetController(const std::string& sName)
+        {
+            for(size_t nController = 0; nController < m_vControllers.size(); ++nController)
+                if(m_vControllers[nController].sName == sName)
+                    return nController;
+            controller c = {sName, -1, 0, 0};
+            m_vControllers.push_back(c);
+            return m_vControllers.size() - 1;
+        }
+
+        /** @brief  Gets a series, adding it if new */
+        Series& GetSeries(size_t nController, byte nSensor)
+        {
+            for(size_t nSeries = 0; nSeries < m_vSeries.size(); ++nSeries)
+                if(m_vSeries[nSeries].GetController() == nController && m_vSeries[nSeries].GetSensor() == nSensor)
+                    return m_vSeries[nSeries];
+            m_vSeries.push_back(Series(nController, nSensor));
+            return m_vSeries.back();
+        }
+
+        /** @brief  Adds the readings of a journal image that are newer than those in store
+        *   @param  sName Controller name
+        *   @param  sFile Image file (JOURNAL_PAGES * JOURNAL_PAGE_SIZE bytes)
+        *   @return <i>long</i> Quantity of readings added or -1 on error
+        */
+        long AddImage(const std::string& sName, const char* sFile)
+        {
+            FILE* pFile = fopen(sFile, "rb");
+            if(!pFile)
+            {
+                perror(sFile);
+                return -1;
+            }
+            size_t nRead = fread(g_journalChip, 1, (size_t)JOURNAL_PAGES * JOURNAL_PAGE_SIZE, pFile);
+            fclose(pFile);
+            if(nRead != (size_t)JOURNAL_PAGES * JOURNAL_PAGE_SIZE)
+            {
+                fprintf(stderr, "%s is not a %u byte journal image\n", sFile, JOURNAL_PAGES * JOURNAL_PAGE_SIZE);
+                return -1;
+            }
+            g_bJournalChipErased = true; //Stand-in now holds image
+            JournalBegin();
+            size_t nController = GetController(sName);
+            controller& c = m_vControllers[nController];
+            unsigned int nPages = (g_lJournalSequence < JOURNAL_PAGES) ? g_lJournalSequence : JOURNAL_PAGES;
+            long lAdded = 0;
+            byte page[JOURNAL_PAGE_SIZE];
+            for(unsigned int nPage = 0; nPage < nPages; ++nPage)
+            {
+                unsigned long lSequence;
+                if(!JournalReadPage((g_nJournalPage + JOURNAL_PAGES - nPages + nPage) % JOURNAL_PAGES, page, &lSequence))
+                    continue; //Failed CRC
+                if((long)lSequence <= c.lLastSequence)
+                    continue; //Already in store
+                if(c.lLastSequence >= 0 && (long)lSequence != c.lLastSequence + 1)
+                    fprintf(stderr, "%s: %ld journal pages lost after sequence %ld (wrapped before image was loaded or failed CRC)\n",
+                        sFile, (long)lSequence - c.lLastSequence - 1, c.lLastSequence);
+                c.lLastSequence = lSequence;
+                for(byte nRecord = 0; nRecord < JOURNAL_RECORDS; ++nRecord)
+                {
+                    journalRecord record;
+                    if(!JournalGetRecord(page, nRecord, &record) || record.nMinute >= MINUTES_PER_WEEK)
+                        continue;
+                    if((int)record.nMinute < c.nLastMinute)
+                        ++c.lWeek;
+                    c.nLastMinute = record.nMinute;
+                    if(record.nType != JOURNAL_READING)
+                        continue;
+                    GetSeries(nController, record.nArg).Append(c.lWeek * MINUTES_PER_WEEK + record.nMinute, record.nValue);
+                    ++lAdded;
+                }
+            }
+            return lAdded;
+        }
+
+        /** @brief  Loads store from file
+        *   @return <i>bool</i> True on success or if file does not exist
+        *   @note   Only readings are saved. Rollups are rebuilt as readings are appended.
+        */
+        bool Load(const char* sFile)
+        {
+            FILE* pFile = fopen(sFile, "rb");
+            if(!pFile)
+                return true; //New store
+            char magic[sizeof(STORE_MAGIC)];
+            uint32_t nControllers = 0;
+            bool bValid = fread(magic, sizeof(magic), 1, pFile) == 1 && 0 == memcmp(magic, STORE_MAGIC, sizeof(magic))
+                && fread(&nControllers, sizeof(nControllers), 1, pFile) == 1;
+            for(uint32_t nController = 0; bValid && nController < nControllers; ++nController)
+            {
+                uint32_t nLength = 0;
+                char sName[256];
+                controller c;
+                bValid = fread(&nLength, sizeof(nLength), 1, pFile) == 1 && nLength < sizeof(sName)
+                    && fread(sName, 1, nLength, pFile) == nLength && fread(&c.lLastSequence, sizeof(c.lLastSequence), 1, pFile) == 1
+                    && fread(&c.lWeek, sizeof(c.lWeek), 1, pFile) == 1 && fread(&c.nLastMinute, sizeof(c.nLastMinute), 1, pFile) == 1;
+                c.sName.assign(sName, bValid ? nLength : 0);
+                m_vControllers.push_back(c);
+            }
+            uint32_t nSeries = 0;
+            bValid = bValid && fread(&nSeries, sizeof(nSeries), 1, pFile) == 1;
+            for(uint32_t nIndex = 0; bValid && nIndex < nSeries; ++nIndex)
+            {
+                uint32_t nController, nSize;
+                byte nSensor;
+                bValid = fread(&nController, sizeof(nController), 1, pFile) == 1 && nController < m_vControllers.size()
+                    && fread(&nSensor, sizeof(nSensor), 1, pFile) == 1 && fread(&nSize, sizeof(nSize), 1, pFile) == 1;
+                if(!bValid)
+                    break;
+                std::vector<int32_t> vMinute(nSize);
+                std::vector<int16_t> vValue(nSize);
+                bValid = fread(vMinute.data(), sizeof(int32_t), nSize, pFile) == nSize && fread(vValue.data(), sizeof(int16_t), nSize, pFile) == nSize;
+                Series& series = GetSeries(nController, nSensor);
+                for(uint32_t i = 0; bValid && i < nSize; ++i)
+                    series.Append(vMinute[i], vValue[i]);
+            }
+            fclose(pFile);
+            if(!bValid)
+                fprintf(stderr, "%s is not a valid store\n", sFile);
+            return bValid;
+        }
+
+        /** @brief  Saves store to file
+        *   @return <i>bool</i> True on success
+        */
+        bool Save(const char* sFile) const
+        {
+            FILE* pFile = fopen(sFile, "wb");
+            if(!pFile)
+            {
+                perror(sFile);
+                return false;
+            }
+            fwrite(STORE_MAGIC, sizeof(STORE_MAGIC), 1, pFile);
+            uint32_t nControllers = m_vControllers.size();
+            fwrite(&nControllers, sizeof(nControllers), 1, pFile);
+            for(size_t nController = 0; nController < m_vControllers.size(); ++nController)
+            {
+                const controller& c = m_vControllers[nController];
+                uint32_t nLength = c.sName.size();
+                fwrite(&nLength, sizeof(nLength), 1, pFile);
+                fwrite(c.sName.data(), 1, nLength, pFile);
+                fwrite(&c.lLastSequence, sizeof(c.lLastSequence), 1, pFile);
+                fwrite(&c.lWeek, sizeof(c.lWeek), 1, pFile);
+                fwrite(&c.nLastMinute, sizeof(c.nLastMinute), 1, pFile);
+            }
+            uint32_t nSeries = m_vSeries.size();
+            fwrite(&nSeries, sizeof(nSeries), 1, pFile);
+            for(size_t nIndex = 0; nIndex < m_vSeries.size(); ++nIndex)
+            {
+                const Series& series = m_vSeries[nIndex];
+                uint32_t nController = series.GetController();
+                byte nSensor = series.GetSensor();
+                uint32_t nSize = series.GetSize();
+                fwrite(&nController, sizeof(nController), 1, pFile);
+                fwrite(&nSensor, sizeof(nSensor), 1, pFile);
+                fwrite(&nSize, sizeof(nSize), 1, pFile);
+                fwrite(series.GetMinutes().data(), sizeof(int32_t), nSize, pFile);
+                fwrite(series.GetValues().data(), sizeof(int16_t), nSize, pFile);
+            }
+            bool bSuccess = !ferror(pFile);
+            fclose(pFile);
+            return bSuccess;
+        }
+
+        const std::vector<Series>& GetAllSeries() const { return m_vSeries; }
+        const std::string& GetName(size_t nController) const { return m_vControllers[nController].sName; }
+
+    private:
+        std::vector<controller> m_vControllers;
+        std::vector<Series> m_vSeries;
+};
+
+/** @brief  Prints an aggregate as a table row or comma separated values */
+void PrintRow(const Store& store, const Series& series, int nMinute, const aggregate& agg, bool bCsv)
+{
+    if(bCsv)
+        printf("%s,%u,%d,%02d:%02d,%.2f,%.2f,%.2f,%lu\n", store.GetName(series.GetController()).c_str(), series.GetSensor(),
+            nMinute / MINUTES_PER_DAY, nMinute % MINUTES_PER_DAY / 60, nMinute % 60, agg.nMin / 100.0, agg.nMax / 100.0,
+            agg.llSum / 100.0 / agg.lCount, agg.lCount);
+    else
+        printf("%-12s %6u %5d %02d:%02d %7.2f %7.2f %7.2f %7lu\n", store.GetName(series.GetController()).c_str(), series.GetSensor(),
+            nMinute / MINUTES_PER_DAY, nMinute % MINUTES_PER_DAY / 60, nMinute % 60, agg.nMin / 100.0, agg.nMax / 100.0,
+            agg.llSum / 100.0 / agg.lCount, agg.lCount);
+}
+
+/** @brief  Times a year long daily minimum / maximum query of every series with each method
+*   @param  nControllers Quantity of synthetic controllers
+*   @param  nSensors Sensors per controller
+*   @param  nDays Days of per-minute readings
+*/
+void Benchmark(unsigned int nControllers, unsigned int nSensors, unsigned int nDays)
+{
+    Store store;
+    std::mt19937 rng(1);
+    std::normal_distribution<double> noise(0.0, 0.3);
+    for(unsigned int nController = 0; nController < nControllers; ++nController)
+    {
+        size_t nIndex = store.GetController("synthetic" + std::to_string(nController));
+        for(unsigned int nSensor = 0; nSensor < nSensors; ++nSensor)
+        {
+            Series& series = store.GetSeries(nIndex, nSensor);
+            for(int nMinute = 0; nMinute < (int)nDays * MINUTES_PER_DAY; ++nMinute)
+            {
+                double dDay = nMinute / (double)MINUTES_PER_DAY;
+                double dValue = 18.0 + 2.0 * std::cos(2 * M_PI * dDay) + 3.0 * std::cos(2 * M_PI * dDay / 365) + noise(rng);
+                series.Append(nMinute, (int16_t)std::lround(dValue * 100));
+            }
+        }
+    }
+    const std::vector<Series>& vSeries = store.GetAllSeries();
+    printf("%u controllers x %u sensors x %u days of per-minute readings (%lu readings)\n", nControllers, nSensors, nDays,
+        (unsigned long)nControllers * nSensors * nDays * MINUTES_PER_DAY);
+    const char* METHODS[] = {"rollup", "SIMD scan", "scalar scan"};
+    long long llCheck[3];
+    for(int nMethod = 0; nMethod < 3; ++nMethod)
+    {
+        auto tStart = std::chrono::steady_clock::now();
+        long long llTotal = 0; //Consumes results so they are not optimised away and confirms methods agree
+        for(size_t nIndex = 0; nIndex < vSeries.size(); ++nIndex)
+            for(unsigned int nDay = 0; nDay < nDays; ++nDay)
+            {
+                int nFrom = nDay * MINUTES_PER_DAY;
+                aggregate agg = (nMethod == 0) ? vSeries[nIndex].Query(nFrom, nFrom + MINUTES_PER_DAY)
+                    : vSeries[nIndex].QueryRaw(nFrom, nFrom + MINUTES_PER_DAY, nMethod == 1);
+                llTotal += agg.nMin + agg.nMax + agg.llSum;
+            }
+        double dMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tStart).count();
+        llCheck[nMethod] = llTotal;
+        printf("%-12s %10.3f ms\n", METHODS[nMethod], dMs);
+    }
+    if(llCheck[0] != llCheck[1] || llCheck[1] != llCheck[2])
+        fprintf(stderr, "Methods disagree\n");
+}
+
+int main(int argc, char** argv)
+{
+    const char* sStore = NULL;
+    int nResolution = -1; //Rollup level of listing. -1 for summary.
+    int nFromDay = 0;
+    int nToDay = INT_MAX / MINUTES_PER_DAY;
+    bool bCsv = false;
+    bool bBenchmark = false;
+    unsigned int nControllers = 4;
+    unsigned int nSensors = 4;
+    unsigned int nDays = 365;
+    std::vector<std::string> vImages;
+    for(int nArg = 1; nArg < argc; ++nArg)
+    {
+        if(0 == strcmp(argv[nArg], "-c"))
+            bCsv = true;
+        else if(0 == strcmp(argv[nArg], "-b"))
+            bBenchmark = true;
+        else if(nArg + 1 < argc && 0 == strcmp(argv[nArg], "-s"))
+            sStore = argv[++nArg];
+        else if(nArg + 1 < argc && 0 == strcmp(argv[nArg], "-r"))
+        {
+            const char* sLevel = strchr("mhd", argv[++nArg][0]);
+            if(!sLevel || !*sLevel)
+            {
+                fprintf(stderr, "Resolution must be m, h or d\n");
+                return 1;
+            }
+            nResolution = sLevel - "mhd";
+        }
+        else if(nArg + 1 < argc && 0 == strcmp(argv[nArg], "-f"))
+            nFromDay = atoi(argv[++nArg]);
+        else if(nArg + 1 < argc && 0 == strcmp(argv[nArg], "-t"))
+            nToDay = atoi(argv[++nArg]);
+        else if(nArg + 1 < argc && 0 == strcmp(argv[nArg], "-n"))
+            nControllers = atoi(argv[++nArg]);
+        else if(nArg + 1 < argc && 0 == strcmp(argv[nArg], "-k"))
+            nSensors = atoi(argv[++nArg]);
+        else if(nArg + 1 < argc && 0 == strcmp(argv[nArg], "-y"))
+            nDays = atoi(argv[++nArg]);
+        else if(argv[nArg][0] != '-' && strchr(argv[nArg], '='))
+            vImages.push_back(argv[nArg]);
+        else
+        {
+            fprintf(stderr, "Usage: %s [-s store] [-r m|h|d] [-f day] [-t day] [-c] [name=image ...]\n", argv[0]);
+            fprintf(stderr, "       %s -b [-n controllers] [-k sensors] [-y days]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(bBenchmark)
+    {
+        Benchmark(nControllers, nSensors, nDays);
+        return 0;
+    }
+
+    Store store;
+    if(sStore && !store.Load(sStore))
+        return 1;
+    for(size_t nImage = 0; nImage < vImages.size(); ++nImage)
+    {
+        size_t nSplit = vImages[nImage].find('=');
+        long lAdded = store.AddImage(vImages[nImage].substr(0, nSplit), vImages[nImage].c_str() + nSplit + 1);
+        if(lAdded < 0)
+            return 1;
+        fprintf(stderr, "%s: %ld readings added\n", vImages[nImage].c_str(), lAdded);
+    }
+    if(sStore && !vImages.empty() && !store.Save(sStore))
+        return 1;
+
+    const std::vector<Series>& vSeries = store.GetAllSeries();
+    if(bCsv)
+        printf("controller,sensor,day,time,min,max,mean,readings\n");
+    else
+        printf("Controller   Sensor   Day  Time     Min     Max    Mean Readings\n");
+    for(size_t nIndex = 0; nIndex < vSeries.size(); ++nIndex)
+    {
+        const Series& series = vSeries[nIndex];
+        int nFrom = std::max(nFromDay * MINUTES_PER_DAY, series.GetFirst());
+        int nTo = std::min((long)nToDay * MINUTES_PER_DAY, (long)series.GetLast() + 1);
+        if(nResolution < 0)
+        {
+            aggregate agg = series.Query(nFrom, nTo);
+            if(agg.lCount)
+                PrintRow(store, series, nFrom, agg, bCsv);
+            continue;
+        }
+        int nMinutes = LEVEL_MINUTES[nResolution];
+        for(int nBucket = nFrom / nMinutes * nMinutes; nBucket < nTo; nBucket += nMinutes)
+        {
+            aggregate agg = series.Query(std::max(nBucket, nFrom), std::min(nBucket + nMinutes, nTo));
+            if(agg.lCount)
+                PrintRow(store, series, nBucket, agg, bCsv);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,59 @@
+#!/bin/sh
+# riban heating controller - build variant size report
+# Prints .text, .data and .bss of each built variant with the change from the previous variant.
+# Each variant removes the listed features from the one before, so each change is the cost of those features.
+# Then prints the saving of each feature alone: full against the target built with just that feature disabled
+# (headless for LCD, no-x for the others).
+# Usage: tools/variantsize.sh [bin directory]
+# Set AVR_SIZE to use an avr-size other than the one on PATH.
+
+BIN=${1:-bin}
+SIZE=${AVR_SIZE:-avr-size}
+
+printf "%-16s %7s %7s %7s %7s %7s %7s  %s\n" Variant text data bss Dtext Ddata Dbss "Features removed"
+PREV=""
+for VARIANT in full headless minimal-serial
+do
+    case $VARIANT in
+        full) REMOVED="";;
+        headless) REMOVED="LCD";;
+        minimal-serial) REMOVED="SERIAL_HELP DEBUG_DUMP SCAN BENCHMARK DIAG JOURNAL";;
+    esac
+    ELF=$BIN/$VARIANT/heatingcontroller.elf
+    if [ ! -f "$ELF" ]
+    then
+        printf "%-16s not built\n" $VARIANT
+        PREV=""
+        continue
+    fi
+    set -- $($SIZE -B "$ELF" | tail -n 1)
+    if [ -n "$PREV" ]
+    then
+        set -- $1 $2 $3 $PREV
+        printf "%-16s %7d %7d %7d %+7d %+7d %+7d  %s\n" $VARIANT $1 $2 $3 $(($1 - $4)) $(($2 - $5)) $(($3 - $6)) "$REMOVED"
+    else
+        printf "%-16s %7d %7d %7d %7s %7s %7s  %s\n" $VARIANT $1 $2 $3 - - - "$REMOVED"
+    fi
+    PREV="$1 $2 $3"
+done
+
+ELF=$BIN/full/heatingcontroller.elf
+[ -f "$ELF" ] || exit 0
+FULL=$($SIZE -B "$ELF" | tail -n 1)
+printf "\n%-16s %7s %7s %7s  %s\n" Feature Dtext Ddata Dbss Target
+for FEATURE in LCD SERIAL_HELP DEBUG_DUMP SCAN BENCHMARK DIAG JOURNAL
+do
+    case $FEATURE in
+        LCD) VARIANT=headless;;
+        *) VARIANT=no-$(echo $FEATURE | tr 'A-Z_' 'a-z-');;
+    esac
+    ELF=$BIN/$VARIANT/heatingcontroller.elf
+    if [ ! -f "$ELF" ]
+    then
+        printf "%-16s %7s %7s %7s  %s not built\n" $FEATURE - - - $VARIANT
+        continue
+    fi
+    set -- $($SIZE -B "$ELF" | tail -n 1)
+    set -- $1 $2 $3 $FULL
+    printf "%-16s %+7d %+7d %+7d  %s\n" $FEATURE $(($1 - $4)) $(($2 - $5)) $(($3 - $6)) $VARIANT
+done
@@ -0,0 +1,178 @@
+/** riban heating controller - interrupt driven I2C (TWI) master
+*   Replaces the Wire library which spins on the TWI hardware and never returns if SDA is held low.
+*   Buffers passed to TwiStart must remain valid until the transaction completes.
+*/
+
+#include "twi.h"
+#include "fastio.h"
+
+const unsigned long TWI_FREQUENCY = 100000; //SCL frequency (Hz)
+const unsigned long TWI_TIMEOUT_MS = 10; //Maximum duration of a transaction (ms)
+const byte PIN_SDA = A4;
+const byte PIN_SCL = A5;
+
+//TWI status codes (TWSR with prescaler bits masked)
+const byte TWS_START = 0x08;
+const byte TWS_REPEATED_START = 0x10;
+const byte TWS_SLAW_ACK = 0x18;
+const byte TWS_DATA_TX_ACK = 0x28;
+const byte TWS_SLAR_ACK = 0x40;
+const byte TWS_DATA_RX_ACK = 0x50;
+const byte TWS_DATA_RX_NACK = 0x58;
+
+const byte TWCR_ACTIVE = _BV(TWEN) | _BV(TWIE) | _BV(TWINT); //Clear interrupt flag to continue transaction
+
+volatile byte g_nTwiStatus = TWI_OK;
+byte g_nTwiAddress;
+const byte* g_pTwiWrite;
+volatile byte g_nTwiWriteLength; //Cleared when write phase complete
+byte* g_pTwiRead;
+byte g_nTwiReadLength;
+byte g_nTwiIndex;
+unsigned long g_lTwiStart; //millis() when transaction started
+unsigned int g_nTwiErrors = 0;
+unsigned int g_nTwiTimeouts = 0;
+
+/** @brief  Initialises TWI hardware as bus master */
+void TwiBegin()
+{
+    FastPin<PIN_SDA>::Port() |= FastPin<PIN_SDA>::MASK; //Enable internal pull-ups
+    FastPin<PIN_SCL>::Port() |= FastPin<PIN_SCL>::MASK;
+    TWSR = 0; //Prescaler = 1
+    TWBR = ((F_CPU / TWI_FREQUENCY) - 16) / 2;
+    TWCR = _BV(TWEN);
+}
+
+/** @brief  Starts a transaction
+*   @param  nAddress 7-bit slave address
+*   @param  pWrite Pointer to data to write
+*   @param  nWriteLength Quantity of bytes to write
+*   @param  pRead Pointer to buffer for data read after write (repeated start)
+*   @param  nReadLength Quantity of bytes to read
+*   @return <i>bool</i> True if started. False if a transaction is already in progress.
+*/
+bool TwiStart(byte nAddress, const byte* pWrite, byte nWriteLength, byte* pRead, byte nReadLength)
+{
+    if(TwiStatus() == TWI_BUSY)
+        return false;
+    g_nTwiAddress = nAddress;
+    g_pTwiWrite = pWrite;
+    g_nTwiWriteLength = nWriteLength;
+    g_pTwiRead = pRead;
+    g_nTwiReadLength = nReadLength;
+    g_nTwiIndex = 0;
+    g_lTwiStart = millis();
+    g_nTwiStatus = TWI_BUSY;
+    TWCR = TWCR_ACTIVE | _BV(TWSTA);
+    return true;
+}
+
+/** @brief  Gets status of current or last transaction
+*   @return <i>byte</i> TWI_OK, TWI_BUSY, TWI_ERROR or TWI_TIMEOUT
+*   @note   Aborts transaction and recovers bus if transaction has timed out
+*/
+byte TwiStatus()
+{
+    if(g_nTwiStatus == TWI_BUSY && millis() - g_lTwiStart > TWI_TIMEOUT_MS)
+    {
+        byte nSreg = SREG;
+        cli();
+        if(g_nTwiStatus == TWI_BUSY)
+        {
+            TWCR = 0; //Release pins from TWI hardware
+            TwiRecover();
+            TwiBegin();
+            ++g_nTwiTimeouts;
+            g_nTwiStatus = TWI_TIMEOUT;
+        }
+        SREG = nSreg;
+    }
+    return g_nTwiStatus;
+}
+
+/** @brief  Waits for current transaction to complete
+*   @return <i>bool</i> True if transaction succeeded
+*   @note   Blocks for no longer than TWI_TIMEOUT_MS
+*/
+bool TwiWait()
+{
+    while(TwiStatus() == TWI_BUSY)
+        ;
+    return g_nTwiStatus == TWI_OK;
+}
+
+/** @brief  Frees a slave holding SDA low
+*   @note   Clocks SCL up to 9 times until SDA is released then generates a stop condition. TWI must be disabled.
+*/
+void TwiRecover()
+{
+    //Pins driven low by setting as output with port low, released by setting as input (external pull-up)
+    FastPin<PIN_SDA>::Port() &= ~FastPin<PIN_SDA>::MASK;
+    FastPin<PIN_SCL>::Port() &= ~FastPin<PIN_SCL>::MASK;
+    for(byte nClock = 0; nClock < 9 && !FastPin<PIN_SDA>::Get(); ++nClock)
+    {
+        FastPin<PIN_SCL>::Direction() |= FastPin<PIN_SCL>::MASK;
+        delayMicroseconds(5);
+        FastPin<PIN_SCL>::Direction() &= ~FastPin<PIN_SCL>::MASK;
+        delayMicroseconds(5);
+    }
+    //Stop condition: SDA rises while SCL high
+    FastPin<PIN_SDA>::Direction() |= FastPin<PIN_SDA>::MASK;
+    delayMicroseconds(5);
+    FastPin<PIN_SDA>::Direction() &= ~FastPin<PIN_SDA>::MASK;
+    delayMicroseconds(5);
+}
+
+/** @brief  Ends transaction with stop condition
+*   @param  nStatus Status of completed transaction
+*/
+static void TwiStop(byte nStatus)
+{
+    TWCR = _BV(TWEN) | _BV(TWINT) | _BV(TWSTO);
+    if(nStatus != TWI_OK)
+        ++g_nTwiErrors;
+    g_nTwiStatus = nStatus;
+}
+
+/** @brief  TWI interrupt - advances transaction state machine */
+ISR(TWI_vect)
+{
+    switch(TWSR & 0xF8)
+    {
+    case TWS_START:
+    case TWS_REPEATED_START:
+        TWDR = (g_nTwiAddress << 1) | (g_nTwiWriteLength ? 0 : 1); //SLA+W during write phase, SLA+R during read phase
+        TWCR = TWCR_ACTIVE;
+        break;
+    case TWS_SLAW_ACK:
+    case TWS_DATA_TX_ACK:
+        if(g_nTwiIndex < g_nTwiWriteLength)
+        {
+            TWDR = g_pTwiWrite[g_nTwiIndex++];
+            TWCR = TWCR_ACTIVE;
+        }
+        else if(g_nTwiReadLength)
+        {
+            g_nTwiWriteLength = 0;
+            TWCR = TWCR_ACTIVE | _BV(TWSTA);
+        }
+        else
+            TwiStop(TWI_OK);
+        break;
+    case TWS_SLAR_ACK:
+        g_nTwiIndex = 0;
+        TWCR = TWCR_ACTIVE | (g_nTwiReadLength > 1 ? _BV(TWEA) : 0); //NACK last byte
+        break;
+    case TWS_DATA_RX_ACK:
+        g_pTwiRead[g_nTwiIndex++] = TWDR;
+        TWCR = TWCR_ACTIVE | (g_nTwiIndex + 1 < g_nTwiReadLength ? _BV(TWEA) : 0);
+        break;
+    case TWS_DATA_RX_NACK:
+        g_pTwiRead[g_nTwiIndex] = TWDR;
+        TwiStop(TWI_OK);
+        break;
+    default:
+        //NACK, arbitration lost or bus error
+        TwiStop(TWI_ERROR);
+    }
+}
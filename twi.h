@@ -0,0 +1,25 @@
+/** riban heating controller - interrupt driven I2C (TWI) master
+*   Transactions run from the TWI interrupt so the caller may continue other work and poll for completion.
+*   A transaction that does not complete within TWI_TIMEOUT is aborted and the bus is recovered by clocking SCL
+*   until the slave releases SDA, so a wedged bus cannot stall the caller.
+*/
+#ifndef TWI_H
+#define TWI_H
+
+#include "Arduino.h"
+
+const byte TWI_OK = 0; //Last transaction completed
+const byte TWI_BUSY = 1; //Transaction in progress
+const byte TWI_ERROR = 2; //Last transaction failed (NACK, arbitration lost or bus error)
+const byte TWI_TIMEOUT = 3; //Last transaction timed out and bus was recovered
+
+void TwiBegin();
+bool TwiStart(byte nAddress, const byte* pWrite, byte nWriteLength, byte* pRead = NULL, byte nReadLength = 0);
+byte TwiStatus();
+bool TwiWait();
+void TwiRecover();
+
+extern unsigned int g_nTwiErrors; //Quantity of failed transactions
+extern unsigned int g_nTwiTimeouts; //Quantity of transactions aborted with bus recovery
+
+#endif // TWI_H
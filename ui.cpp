@@ -0,0 +1,242 @@
+/** riban heating controller - LCD and button user interface
+*   16x2 LCD shows the clock or a zone's temperature and set-point. Up and down buttons select a zone, OK edits its set-point.
+*/
+#include "ui.h"
+
+#if FEATURE_LCD
+
+#include "Arduino.h"
+#include "fastio.h"
+#include "format.h"
+#include "log.h"
+#include "scratch.h"
+#include <LiquidCrystal.h>
+#include <ribanTimer.h>
+
+const unsigned int TIMEOUT_MENU = 30000; //ms to wait before returning to clock display
+const unsigned int TIMEOUT_EDIT = 10000; //ms to wait before returning to clock display
+
+const unsigned int PIN_BUTTON_DOWN = A1;
+const unsigned int PIN_BUTTON_UP = A3;
+const unsigned int PIN_BUTTON_OK = A2;
+const unsigned int PIN_LCDD7 = 2;
+const unsigned int PIN_LCDD6 = 3;
+const unsigned int PIN_LCDD5 = 4;
+const unsigned int PIN_LCDD4 = 5;
+const unsigned int PIN_LCDRS = 6;
+const unsigned int PIN_LCDE = 10;
+
+//Buttons are read together with a single port read
+typedef char ButtonsOnSamePort[(FastPin<PIN_BUTTON_UP>::PORT_ID == FastPin<PIN_BUTTON_DOWN>::PORT_ID &&
+                                FastPin<PIN_BUTTON_UP>::PORT_ID == FastPin<PIN_BUTTON_OK>::PORT_ID) ? 1 : -1];
+
+unsigned int g_nWaterLowTemp = 80;
+unsigned int g_nWaterHighTemp = 600;
+byte g_nSelectedZone = 0xFF;
+bool g_bButtonDown = true;
+bool g_bButtonUp = true;
+bool g_bButtonOk = true;
+bool g_bEdit = false;
+
+Timer timerDebounce; //Instantiate a button debounce timer
+Timer timerDisplayTimeout; //Instantiate a timer for display (edit mode) timeout
+LiquidCrystal g_lcd(PIN_LCDRS, PIN_LCDE, PIN_LCDD4, PIN_LCDD5, PIN_LCDD6, PIN_LCDD7);
+
+void OnButtonUpDown(bool bUp);
+void OnButtonOk(bool bState);
+void ToggleEdit();
+
+/** @brief  Initialises buttons and LCD */
+void UiBegin()
+{
+    pinMode(PIN_BUTTON_OK, INPUT_PULLUP);
+    pinMode(PIN_BUTTON_DOWN, INPUT_PULLUP);
+    pinMode(PIN_BUTTON_UP, INPUT_PULLUP);
+    g_lcd.begin(16, 2); //initialise 16x2 LCD
+}
+
+/** @brief  Handles buttons and display timeout - call from main loop */
+void UiPoll()
+{
+    if(!timerDebounce.IsTriggered())
+    {
+        byte nButtons = FastPin<PIN_BUTTON_UP>::Input(); //All buttons share a port
+        bool bState = nButtons & FastPin<PIN_BUTTON_UP>::MASK;
+        if(g_bButtonUp != bState)
+        {
+            g_bButtonUp = bState;
+            timerDebounce.start(30, true);
+            if(!g_bButtonUp)
+                OnButtonUpDown(true);
+        }
+        bState = nButtons & FastPin<PIN_BUTTON_DOWN>::MASK;
+        if(g_bButtonDown != bState)
+        {
+            g_bButtonDown = bState;
+            timerDebounce.start(30, true);
+            if(!g_bButtonDown)
+                OnButtonUpDown(false);
+        }
+        bState = nButtons & FastPin<PIN_BUTTON_OK>::MASK;
+        if(g_bButtonOk != bState)
+        {
+            g_bButtonOk = bState;
+            timerDebounce.start(30, true);
+            OnButtonOk(g_bButtonOk);
+        }
+    }
+    if(timerDisplayTimeout.IsTriggered())
+    {
+        ToggleEdit();
+    }
+}
+
+/** @brief  Checks whether LCD is showing the clock
+*   @return <i>bool</i> True if no zone is selected
+*/
+bool UiShowingClock()
+{
+    return g_nSelectedZone == 0xFF;
+}
+
+/** @brief  Shows clock on LCD
+*   @param  sTime Time formatted "hh:mm..." - first five characters are shown on first line
+*   @param  sDate Date shown on second line
+*/
+void UiShowClock(const char* sTime, const char* sDate)
+{
+    g_lcd.clear();
+    g_lcd.write((const uint8_t*)sTime, 5);
+    g_lcd.setCursor(0,1);
+    g_lcd.print(sDate);
+}
+
+/** @brief  Deselects zone and returns LCD to clock */
+void UiHome()
+{
+    g_nSelectedZone = 0xFF;
+    getTime(true, false);
+}
+
+/** @brief  Redraws both LCD lines with test pattern (used by benchmark) */
+void UiTest()
+{
+    g_lcd.clear();
+    g_lcd.print("0123456789ABCDEF");
+    g_lcd.setCursor(0, 1);
+    g_lcd.print("0123456789ABCDEF");
+}
+
+void OnButtonUpDown(bool bUp)
+{
+    LOG_IF(LOG_DEBUG, LOG_UI)
+        Serial.println(bUp ? F("Button up") : F("Button down"));
+    if(g_bEdit)
+    {
+        if(g_zones[g_nSelectedZone].bSpace)
+        {
+            if(bUp)
+            {
+                if(g_zones[g_nSelectedZone].nSetpoint < 100)
+                    g_zones[g_nSelectedZone].nSetpoint = g_zones[g_nSelectedZone].nSetpoint + 1;
+            }
+            else
+                if(g_zones[g_nSelectedZone].nSetpoint > 0)
+                    g_zones[g_nSelectedZone].nSetpoint = g_zones[g_nSelectedZone].nSetpoint - 1;
+        }
+        else
+        {
+            if(bUp)
+                g_zones[g_nSelectedZone].nSetpoint = g_nWaterHighTemp;
+            else
+                g_zones[g_nSelectedZone].nSetpoint = g_nWaterLowTemp;
+        }
+    }
+    else
+    {
+        if(bUp)
+            ++g_nSelectedZone;
+        else
+        {
+            if(g_nSelectedZone == 0xFF)
+                g_nSelectedZone = 10;
+            --g_nSelectedZone;
+        }
+        if(g_nSelectedZone > 9)
+        {
+            g_nSelectedZone = 0xFF;
+            UiHome();
+            return;
+        }
+        timerDisplayTimeout.start(TIMEOUT_MENU, true);
+    }
+    //Line 1: "nnnnnnnnnn tt.tC" - zone name and lowest sensor value in zone
+    Scratch<20> scratchLine;
+    if(!scratchLine.Valid())
+        return;
+    char* sLine = scratchLine.Chars();
+    char* pLine = FormatString(sLine, g_zones[g_nSelectedZone].sName, 10);
+    *pLine++ = ' ';
+    bool bFound = false;
+    int nValue = 0;
+    for(unsigned int i = 0; i < g_nSensorQuant; ++i)
+    {
+        if((g_sensors[i].nZone == g_nSelectedZone) && (!bFound || g_sensors[i].nValue < nValue))
+        {
+            nValue = g_sensors[i].nValue;
+            bFound = true;
+        }
+    }
+    if(bFound)
+        pLine = FormatFixed(pLine, nValue / 10, 1, 4);
+    else
+        pLine = FormatString(pLine, "??.?");
+    FormatString(pLine, "C");
+    g_lcd.clear();
+    g_lcd.print(sLine);
+    //Line 2: "Setpoint: ss.sC"
+    pLine = FormatString(sLine, "Setpoint: ");
+    pLine = FormatFixed(pLine, g_zones[g_nSelectedZone].nSetpoint, 1, 4);
+    FormatString(pLine, "C");
+    g_lcd.setCursor(0,1);
+    g_lcd.print(sLine);
+    g_lcd.setCursor(13, 1);
+}
+
+void OnButtonOk(bool bState)
+{
+    LOG_IF(LOG_DEBUG, LOG_UI)
+        Serial.println(bState ? F("Button ok released") : F("Button ok pressed"));
+    if(bState)
+        return;
+    if(g_nSelectedZone == 0xFF)
+        return;
+    if(!g_bEdit)
+    {
+        g_bEdit = true;
+        g_lcd.blink();
+        timerDisplayTimeout.start(TIMEOUT_EDIT, true);
+    }
+    else
+    {
+        g_lcd.noBlink();
+        g_bEdit = false;
+    }
+}
+
+void ToggleEdit()
+{
+    if(g_bEdit)
+    {
+        g_bEdit = false;
+        g_lcd.noBlink();
+        timerDisplayTimeout.start(TIMEOUT_EDIT);
+    }
+    else
+    {
+        UiHome();
+        timerDisplayTimeout.start(TIMEOUT_MENU);
+    }
+}
+
+#endif // FEATURE_LCD
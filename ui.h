@@ -0,0 +1,38 @@
+/** riban heating controller - LCD and button user interface
+*   16x2 LCD shows the clock or a zone's temperature and set-point. Up and down buttons select a zone, OK edits its set-point.
+*   When FEATURE_LCD is disabled the functions are empty so a headless build carries no LCD, button or timer code.
+*/
+#ifndef UI_H
+#define UI_H
+
+#include "feature.h"
+#include "control.h"
+
+#if FEATURE_LCD
+void UiBegin();
+void UiPoll();
+bool UiShowingClock();
+void UiShowClock(const char* sTime, const char* sDate);
+void UiHome();
+void UiTest();
+#else
+inline void UiBegin() {}
+inline void UiPoll() {}
+inline bool UiShowingClock() { return false; }
+inline void UiShowClock(const char*, const char*) {}
+inline void UiHome() {}
+#endif // FEATURE_LCD
+
+//Provided by application
+extern sensor g_sensors[]; //Sensors shown for selected zone
+extern zone g_zones[]; //Zones shown and edited
+extern unsigned int g_nSensorQuant; //Quantity of sensors
+
+/** @brief  Reads the RTC - implemented by application
+*   @param  bShow Show result on LCD if true and LCD is showing clock
+*   @param  bPrint Print result to serial if true
+*   @return <i>byte</i> Number of seconds since minute boundary
+*/
+byte getTime(bool bShow, bool bPrint);
+
+#endif // UI_H